@@ -0,0 +1,27 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+uniform sampler2D al_tex;
+uniform vec2 resolution;
+uniform float zoom;
+uniform float fade;
+varying vec2 varying_texcoord;
+
+void main() {
+	// snap to the low-res canvas, which gives us the nearest-neighbour upscale for free
+	vec2 pixel = floor(varying_texcoord * resolution);
+	vec2 uv = ((pixel + 0.5) / resolution + zoom * 0.05) / (1.0 + zoom * 0.1);
+
+	vec4 text = vec4(0.0);
+	if (all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)))) {
+		text = texture2D(al_tex, uv) * fade;
+	}
+	vec3 color = text.rgb + vec3(35.0, 31.0, 32.0) / 255.0 * (1.0 - text.a);
+
+	// checkerboard
+	if (mod(pixel.x, 2.0) < 0.5 && mod(pixel.y, 2.0) < 0.5) {
+		color *= 1.0 - 64.0 / 255.0;
+	}
+	gl_FragColor = vec4(color, 1.0);
+}
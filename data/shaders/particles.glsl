@@ -0,0 +1,17 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+uniform sampler2D al_tex;
+uniform bool textured;
+varying vec2 varying_texcoord;
+varying vec4 varying_color;
+
+void main() {
+	if (textured) {
+		gl_FragColor = texture2D(al_tex, varying_texcoord) * varying_color;
+	} else {
+		float alpha = clamp(1.0 - distance(varying_texcoord, vec2(0.5, 0.5)) * 2.0, 0.0, 1.0);
+		gl_FragColor = varying_color * alpha * alpha;
+	}
+}
@@ -0,0 +1,72 @@
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#define PI 3.14159265
+#define TRAIL_LENGTH 32
+#define TIME_PERIOD 3600.0 // must match particles.c
+
+attribute vec4 al_pos; // corner of the particle's quad, -1 to 1
+attribute vec4 al_user_attr_0; // random seeds, 0 to 1
+uniform mat4 al_projview_matrix;
+
+uniform int kind; // 0 - stars, 1 - snow, 2 - sleigh trail
+uniform float time; // wraps around every TIME_PERIOD
+uniform float shuffle;
+uniform vec2 viewport;
+uniform vec2 sprite;
+uniform vec2 trail[TRAIL_LENGTH]; // Santa's recent positions, a ring buffer
+uniform float trail_head; // index of the newest one
+uniform float trail_interval;
+uniform float trail_phase; // time since trail[0] was recorded
+uniform float trail_alpha;
+
+varying vec2 varying_texcoord;
+varying vec4 varying_color;
+
+float Repeating(float rate) {
+	// Rounds a rate (in cycles per second) to a whole number of cycles per TIME_PERIOD,
+	// so that the motion doesn't jump when the time wraps around.
+	return floor(rate * TIME_PERIOD + 0.5) / TIME_PERIOD;
+}
+
+void main() {
+	vec4 seed = al_user_attr_0;
+	vec2 corner = al_pos.xy;
+	vec2 center;
+	vec2 size;
+	float rotation = 0.0;
+
+	if (kind == 0) {
+		// new sky for every level
+		seed = fract(seed + shuffle * vec4(0.6180339, 0.7548776, 0.5698403, 0.4656386));
+		// the twinkle runs at 4.2 times the rotation, so that one needs whole multiples of 5 cycles
+		float speed = Repeating((fract(seed.z * 43.758) * 0.1 + 1.0) / (10.0 * PI)) * 10.0 * PI;
+		float deviation = fract(seed.w * 91.345);
+		float counter = seed.z * PI + time * speed;
+		float shininess = (1.0 - (cos(counter * 4.2) + 1.0) * 0.1) * 0.8;
+
+		center = seed.xy * viewport;
+		size = sprite * 0.5 * (seed.w * 0.5 + 0.75) * 0.8;
+		rotation = sin(counter) * deviation;
+		varying_color = vec4(vec3(shininess), 1.0);
+	} else if (kind == 1) {
+		float fall = Repeating(0.03 + seed.w * 0.07);
+		float sway = sin(time * Repeating((0.5 + seed.z) / (2.0 * PI)) * 2.0 * PI + seed.w * 2.0 * PI) * 0.01;
+		center = vec2(fract(seed.x + sway + time * Repeating(0.004)), fract(seed.y + time * fall) * 1.1 - 0.05) * viewport;
+		size = vec2(3.0 + seed.z * 7.0);
+		varying_color = vec4(0.3 + seed.z * 0.5);
+	} else {
+		float slot = min(floor(seed.x * float(TRAIL_LENGTH)), float(TRAIL_LENGTH - 1));
+		float age = slot * trail_interval + trail_phase;
+		float life = 1.0 - age / (float(TRAIL_LENGTH) * trail_interval);
+		center = (trail[int(mod(trail_head + slot, float(TRAIL_LENGTH)))] + (seed.yz - 0.5) * 0.012 + vec2(0.0, age * 0.015)) * viewport;
+		size = vec2(4.0 + seed.w * 8.0) * life;
+		varying_color = vec4(1.0, 0.85, 0.4, 1.0) * life * seed.w * trail_alpha;
+	}
+
+	vec2 offset = corner * size;
+	offset = vec2(offset.x * cos(rotation) - offset.y * sin(rotation), offset.x * sin(rotation) + offset.y * cos(rotation));
+	varying_texcoord = corner * 0.5 + 0.5;
+	gl_Position = al_projview_matrix * vec4(center + offset, 0.0, 1.0);
+}
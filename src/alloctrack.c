@@ -0,0 +1,318 @@
+/*! \file alloctrack.c
+ *  \brief Heap allocation tracking for the main loop.
+ *
+ *  Only compiled in with -DALLOC_TRACKING=ON (glibc only). The allocator
+ *  entry points get replaced with wrappers that forward to glibc and count
+ *  every allocation made on the main thread, split by the gamestate that was
+ *  running, by the phase of the frame (event handling, logic, drawing, or the
+ *  engine's own work in between) and by the call stack that made it.
+ *
+ *  With --alloc-check, the game jumps straight into a bot-driven level and
+ *  quits after given number of seconds; any allocation made during a frame
+ *  of a running level (after a short warm-up) counts as a failure and makes
+ *  the process exit with an error.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef ALLOC_TRACKING
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for dladdr
+#endif
+
+#include "alloctrack.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <libsuperderpy.h>
+#include <pthread.h>
+
+#define STACK_DEPTH 5
+#define MAX_SITES 1024
+#define MAX_GAMESTATES 8
+#define WARMUP_FRAMES 60
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static const char* PhaseNames[ALLOC_PHASES] = {
+	[ALLOC_PHASE_ENGINE] = "engine",
+	[ALLOC_PHASE_EVENT] = "events",
+	[ALLOC_PHASE_LOGIC] = "logic",
+	[ALLOC_PHASE_DRAW] = "draw",
+};
+
+struct Site {
+	void* stack[STACK_DEPTH];
+	int depth;
+	enum AllocPhase phase;
+	int gamestate;
+	long count, steady;
+	size_t bytes;
+};
+
+static struct {
+	bool enabled, busy;
+	pthread_t main_thread;
+	enum AllocPhase phase;
+
+	double check_duration, check_start;
+	bool check, steady;
+	int steady_frames, checked_frames, failed_frames;
+
+	long frames, frame_count, max_frame_count, total_count;
+
+	struct {
+		const char* name;
+		long counts[ALLOC_PHASES];
+		size_t bytes[ALLOC_PHASES];
+	} gamestates[MAX_GAMESTATES]; // the first one collects everything made while no gamestate was running
+	int gamestate, gamestate_count;
+
+	struct Site sites[MAX_SITES];
+	long lost_sites;
+} tracking;
+
+static bool IsCheckedFrame(void) {
+	return tracking.steady && tracking.steady_frames > WARMUP_FRAMES;
+}
+
+static void RecordAllocation(size_t size) {
+	if (!tracking.enabled || tracking.busy || !pthread_equal(pthread_self(), tracking.main_thread)) {
+		return;
+	}
+	tracking.busy = true;
+
+	tracking.gamestates[tracking.gamestate].counts[tracking.phase]++;
+	tracking.gamestates[tracking.gamestate].bytes[tracking.phase] += size;
+	tracking.frame_count++;
+	tracking.total_count++;
+
+	void* stack[STACK_DEPTH + 2];
+	int depth = backtrace(stack, STACK_DEPTH + 2) - 2; // skip ourselves and the allocator wrapper
+	if (depth < 0) {
+		depth = 0;
+	}
+	uintptr_t hash = tracking.phase * MAX_GAMESTATES + tracking.gamestate;
+	for (int i = 0; i < depth; i++) {
+		hash = hash * 31 + (uintptr_t)stack[i + 2];
+	}
+	for (int i = 0; i < MAX_SITES; i++) {
+		struct Site* site = &tracking.sites[(hash + i) % MAX_SITES];
+		if (!site->count) {
+			memcpy(site->stack, stack + 2, sizeof(void*) * depth);
+			site->depth = depth;
+			site->phase = tracking.phase;
+			site->gamestate = tracking.gamestate;
+		}
+		if (site->phase == tracking.phase && site->gamestate == tracking.gamestate && site->depth == depth && memcmp(site->stack, stack + 2, sizeof(void*) * depth) == 0) {
+			site->count++;
+			site->bytes += size;
+			if (IsCheckedFrame()) {
+				site->steady++;
+			}
+			tracking.busy = false;
+			return;
+		}
+	}
+	tracking.lost_sites++;
+	tracking.busy = false;
+}
+
+void* malloc(size_t size) {
+	void* ptr = __libc_malloc(size);
+	RecordAllocation(size);
+	return ptr;
+}
+
+void* calloc(size_t nmemb, size_t size) {
+	void* ptr = __libc_calloc(nmemb, size);
+	RecordAllocation(nmemb * size);
+	return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+	void* result = __libc_realloc(ptr, size);
+	RecordAllocation(size);
+	return result;
+}
+
+void* memalign(size_t alignment, size_t size) {
+	void* ptr = __libc_memalign(alignment, size);
+	RecordAllocation(size);
+	return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+	*memptr = memalign(alignment, size);
+	return *memptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr) {
+	__libc_free(ptr);
+}
+
+void InitAllocationTracking(double check_duration) {
+	void* stack[1];
+	backtrace(stack, 1); // the first call loads libgcc, which allocates
+	tracking.main_thread = pthread_self();
+	tracking.check = check_duration > 0;
+	tracking.check_duration = check_duration;
+	tracking.check_start = al_get_time();
+	tracking.phase = ALLOC_PHASE_ENGINE;
+	tracking.gamestates[0].name = "(none)";
+	tracking.gamestate_count = 1;
+	tracking.enabled = true;
+}
+
+void BeginAllocationFrame(void) {
+	tracking.frame_count = 0;
+	if (tracking.steady) {
+		tracking.steady_frames++;
+	}
+}
+
+bool EndAllocationFrame(void) {
+	// Returns true when the check is over and the game should quit.
+	tracking.frames++;
+	if (tracking.frame_count > tracking.max_frame_count) {
+		tracking.max_frame_count = tracking.frame_count;
+	}
+	if (IsCheckedFrame()) {
+		tracking.checked_frames++;
+		if (tracking.frame_count) {
+			tracking.failed_frames++;
+		}
+	}
+	if (tracking.check_duration && al_get_time() - tracking.check_start > tracking.check_duration) {
+		tracking.steady = false;
+		tracking.check_duration = 0;
+		return true;
+	}
+	return false;
+}
+
+void SetAllocationPhase(enum AllocPhase phase) {
+	tracking.phase = phase;
+}
+
+void EnterAllocationGamestate(const char* name) {
+	// Called from Gamestate_Start; attributes everything that follows to the gamestate until it stops.
+	for (int i = 1; i < tracking.gamestate_count; i++) {
+		if (strcmp(tracking.gamestates[i].name, name) == 0) {
+			tracking.gamestate = i;
+			return;
+		}
+	}
+	if (tracking.gamestate_count == MAX_GAMESTATES) {
+		tracking.gamestate = 0;
+		return;
+	}
+	tracking.gamestate = tracking.gamestate_count++;
+	tracking.gamestates[tracking.gamestate].name = name;
+}
+
+void LeaveAllocationGamestate(const char* name) {
+	// Only if it's still the current one, as the next gamestate may have been started already.
+	if (tracking.gamestate && strcmp(tracking.gamestates[tracking.gamestate].name, name) == 0) {
+		tracking.gamestate = 0;
+	}
+}
+
+void SetAllocationSteadyState(bool steady) {
+	if (steady && !tracking.steady) {
+		tracking.steady_frames = 0;
+	}
+	tracking.steady = steady;
+}
+
+bool IsAllocationCheckRunning(void) {
+	return tracking.check_duration > 0;
+}
+
+long GetAllocationCount(void) {
+	// Allocations made by the main thread so far; the difference between two calls
+	// tells how much a piece of code allocated.
+	return tracking.total_count;
+}
+
+static int CompareSites(const void* a, const void* b) {
+	const struct Site *x = a, *y = b;
+	if (x->steady != y->steady) {
+		return (y->steady > x->steady) ? 1 : -1;
+	}
+	return (y->count > x->count) ? 1 : ((y->count < x->count) ? -1 : 0);
+}
+
+int FinishAllocationTracking(void) {
+	// Prints the report and returns the number of steady state frames that allocated.
+	if (!tracking.enabled) {
+		return 0;
+	}
+	tracking.enabled = false;
+
+	fprintf(stderr, "Allocation report: %ld frames, max %ld allocations in a single frame\n", tracking.frames, tracking.max_frame_count);
+	for (int g = 0; g < tracking.gamestate_count; g++) {
+		fprintf(stderr, "  %s\n", tracking.gamestates[g].name);
+		for (int i = 0; i < ALLOC_PHASES; i++) {
+			fprintf(stderr, "    %-12s %8ld allocations, %10zu bytes\n", PhaseNames[i], tracking.gamestates[g].counts[i], tracking.gamestates[g].bytes[i]);
+		}
+	}
+
+	qsort(tracking.sites, MAX_SITES, sizeof(struct Site), CompareSites);
+	fprintf(stderr, "Call sites (steady state / total):\n");
+	for (int i = 0; i < MAX_SITES && tracking.sites[i].count && i < 40; i++) {
+		struct Site* site = &tracking.sites[i];
+		fprintf(stderr, "  %6ld / %-8ld %-10s %-8s", site->steady, site->count, tracking.gamestates[site->gamestate].name, PhaseNames[site->phase]);
+		for (int j = 0; j < site->depth; j++) {
+			Dl_info info;
+			if (dladdr(site->stack[j], &info) && info.dli_sname) {
+				fprintf(stderr, " < %s+0x%tx", info.dli_sname, (char*)site->stack[j] - (char*)info.dli_saddr);
+			} else {
+				fprintf(stderr, " < %p", site->stack[j]);
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+	if (tracking.lost_sites) {
+		fprintf(stderr, "  (%ld allocations from call sites that didn't fit in the table)\n", tracking.lost_sites);
+	}
+
+	if (!tracking.check) {
+		return 0;
+	}
+	if (!tracking.checked_frames) {
+		fprintf(stderr, "Allocation check FAILED: never reached a steady state\n");
+		return 1;
+	}
+	if (tracking.failed_frames) {
+		fprintf(stderr, "Allocation check FAILED: %d of %d steady state frames allocated\n", tracking.failed_frames, tracking.checked_frames);
+	} else {
+		fprintf(stderr, "Allocation check passed: %d steady state frames without allocations\n", tracking.checked_frames);
+	}
+	return tracking.failed_frames;
+}
+
+#endif
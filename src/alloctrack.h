@@ -0,0 +1,62 @@
+/*! \file alloctrack.h
+ *  \brief Heap allocation tracking for the main loop.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_ALLOCTRACK_H
+#define SECRETSANTA_ALLOCTRACK_H
+
+#include <libsuperderpy.h>
+
+enum AllocPhase {
+	ALLOC_PHASE_ENGINE, // the engine's own work between frames
+	ALLOC_PHASE_EVENT, // from the global event handler through Gamestate_ProcessEvent
+	ALLOC_PHASE_LOGIC,
+	ALLOC_PHASE_DRAW,
+	ALLOC_PHASES
+};
+
+#ifdef ALLOC_TRACKING
+
+void InitAllocationTracking(double check_duration);
+void BeginAllocationFrame(void);
+bool EndAllocationFrame(void);
+void SetAllocationPhase(enum AllocPhase phase);
+void EnterAllocationGamestate(const char* name);
+void LeaveAllocationGamestate(const char* name);
+void SetAllocationSteadyState(bool steady);
+bool IsAllocationCheckRunning(void);
+long GetAllocationCount(void);
+int FinishAllocationTracking(void);
+
+#else
+
+static inline void InitAllocationTracking(double check_duration) {}
+static inline void BeginAllocationFrame(void) {}
+static inline bool EndAllocationFrame(void) { return false; }
+static inline void SetAllocationPhase(enum AllocPhase phase) {}
+static inline void EnterAllocationGamestate(const char* name) {}
+static inline void LeaveAllocationGamestate(const char* name) {}
+static inline void SetAllocationSteadyState(bool steady) {}
+static inline bool IsAllocationCheckRunning(void) { return false; }
+static inline long GetAllocationCount(void) { return 0; }
+static inline int FinishAllocationTracking(void) { return 0; }
+
+#endif
+
+#endif
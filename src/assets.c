@@ -0,0 +1,697 @@
+/*! \file assets.c
+ *  \brief Asset memory accounting.
+ *
+ *  Gamestates load their bitmaps, fonts, samples and music through the
+ *  wrappers here, which keep a record of every asset along with the gamestate
+ *  it belongs to and how much CPU and GPU memory it takes. Bitmaps are
+ *  measured whenever the numbers are needed, since the ones loaded in
+ *  Gamestate_Load only get converted to video bitmaps afterwards. Fonts are
+ *  an estimate: TTF glyphs get rendered into cache pages lazily, so the
+ *  printable ASCII range of a monospace face is assumed to be in use.
+ *
+ *  Assets that aren't needed right away can be given a lazy handle instead,
+ *  which loads them on first use. PrefetchAsset hints that the asset will be
+ *  needed soon and starts loading it on a separate thread, so that the first
+ *  use doesn't stall the frame. Handles remember whether they were ever used;
+ *  the ones that weren't get reported when they are destroyed, as candidates
+ *  for removal.
+ *
+ *  The GPU side of bitmaps is gone when the display gets lost (e.g. on mobile
+ *  when the app gets suspended). Allegro can back the textures up by itself,
+ *  but only by reading every one of them back right when the display goes
+ *  away. Instead, bitmaps loaded from files get decoded from their file again
+ *  ([Graphics] reload_textures, on by default only on Android and the web,
+ *  where the display actually gets lost) and are created with
+ *  ALLEGRO_NO_PRESERVE_TEXTURE, so Allegro doesn't keep a copy. Render targets are created through CreateRenderTarget with a recipe
+ *  that redraws their content. After the display comes back, everything gets
+ *  re-uploaded and rebuilt in one go before the next frame. The time until
+ *  the next frame is done gets reported, for fullscreen toggles as well.
+ *
+ *  Whenever the set of assets changes, the totals are checked against the
+ *  budgets from the [Memory] section (in megabytes): ram_budget and
+ *  vram_budget for everything together, and optionally <gamestate>_ram_budget
+ *  and <gamestate>_vram_budget for a single gamestate. The defaults split the
+ *  512 MB the web build gets between the two. Going over only prints a
+ *  warning. F9 dumps the whole table, largest assets first.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+#define MEGABYTE (1024.0 * 1024.0)
+#define GLYPH_PAGE 256 // size of the TTF addon's glyph cache pages
+#define GLYPH_COUNT 95 // printable ASCII
+
+enum AssetType {
+	ASSET_BITMAP,
+	ASSET_FONT,
+	ASSET_SAMPLE,
+	ASSET_MUSIC,
+	ASSET_SHADER, // only as a lazy handle; not counted
+	ASSET_TYPES
+};
+
+static const char* AssetTypeNames[ASSET_TYPES] = {
+	[ASSET_BITMAP] = "bitmap",
+	[ASSET_FONT] = "font",
+	[ASSET_SAMPLE] = "sample",
+	[ASSET_MUSIC] = "music",
+	[ASSET_SHADER] = "shader",
+};
+
+struct Asset {
+	void* ptr;
+	enum AssetType type;
+	const char* owner;
+	char name[64];
+	size_t cpu, gpu; // for bitmaps these get measured on demand
+	bool estimate;
+
+	bool reload; // from the file it was loaded from, named by its name
+	struct {
+		ALLEGRO_BITMAP** handle; // gets updated with the new bitmap
+		int width, height, flags;
+		AssetRecipe* recipe;
+		void* userdata;
+	} target;
+};
+
+struct LazyAsset {
+	struct Game* game;
+	enum AssetType type;
+	const char* owner;
+	char filename[64], vertex[64];
+	int size, flags;
+	void* ptr;
+	bool loaded, used;
+	ALLEGRO_THREAD* prefetch;
+	int bitmap_flags; // of the thread that asked for the prefetch
+	struct LazyAsset* next;
+};
+
+struct AssetRegistry {
+	struct Game* game;
+	ALLEGRO_MUTEX* mutex; // gamestates get loaded on a separate thread
+	struct Asset* assets;
+	int count, capacity;
+	struct LazyAsset* lazy;
+	bool dirty;
+	size_t ram_budget, vram_budget;
+	bool reload_textures;
+
+	struct {
+		const char* reason;
+		bool lost, restored;
+		double start, duration;
+		int textures, targets;
+		size_t bytes;
+	} recovery;
+};
+
+static size_t GetBudget(struct Game* game, char* key, const char* def) {
+	return strtod(GetConfigOptionDefault(game, "Memory", key, def), NULL) * MEGABYTE;
+}
+
+struct AssetRegistry* CreateAssetRegistry(struct Game* game) {
+	struct AssetRegistry* registry = calloc(1, sizeof(struct AssetRegistry));
+	registry->game = game;
+	registry->mutex = al_create_mutex();
+	registry->ram_budget = GetBudget(game, "ram_budget", "256");
+	registry->vram_budget = GetBudget(game, "vram_budget", "256");
+#if defined(__ANDROID__) || defined(__EMSCRIPTEN__)
+	registry->reload_textures = strtol(GetConfigOptionDefault(game, "Graphics", "reload_textures", "1"), NULL, 10);
+#else
+	registry->reload_textures = strtol(GetConfigOptionDefault(game, "Graphics", "reload_textures", "0"), NULL, 10);
+#endif
+	return registry;
+}
+
+void DestroyAssetRegistry(struct AssetRegistry* registry) {
+	for (struct LazyAsset* asset = registry->lazy; asset; asset = asset->next) {
+		PrintConsole(registry->game, "Assets: lazy %s %s from %s was never destroyed", AssetTypeNames[asset->type], asset->filename, asset->owner);
+	}
+	for (int i = 0; i < registry->count; i++) {
+		PrintConsole(registry->game, "Assets: %s %s from %s was never released", AssetTypeNames[registry->assets[i].type],
+			registry->assets[i].name, registry->assets[i].owner);
+	}
+	al_destroy_mutex(registry->mutex);
+	free(registry->assets);
+	free(registry);
+}
+
+static void TrackAsset(struct Game* game, struct Asset asset, const char* name) {
+	if (!asset.ptr) {
+		return;
+	}
+	struct AssetRegistry* registry = game->data->assets;
+	al_lock_mutex(registry->mutex);
+	if (registry->count == registry->capacity) {
+		registry->capacity = registry->capacity ? registry->capacity * 2 : 32;
+		registry->assets = realloc(registry->assets, registry->capacity * sizeof(struct Asset));
+	}
+	struct Asset* tracked = &registry->assets[registry->count++];
+	*tracked = asset;
+	snprintf(tracked->name, sizeof(tracked->name), "%s", name);
+	registry->dirty = true;
+	al_unlock_mutex(registry->mutex);
+}
+
+static void Track(struct Game* game, void* ptr, enum AssetType type, const char* owner, const char* name, size_t cpu, size_t gpu, bool estimate) {
+	TrackAsset(game, (struct Asset){.ptr = ptr, .type = type, .owner = owner, .cpu = cpu, .gpu = gpu, .estimate = estimate}, name);
+}
+
+void UntrackAsset(struct Game* game, void* ptr) {
+	if (!ptr) {
+		return;
+	}
+	struct AssetRegistry* registry = game->data->assets;
+	al_lock_mutex(registry->mutex);
+	for (int i = 0; i < registry->count; i++) {
+		if (registry->assets[i].ptr == ptr) {
+			registry->assets[i] = registry->assets[--registry->count];
+			registry->dirty = true;
+			break;
+		}
+	}
+	al_unlock_mutex(registry->mutex);
+}
+
+static void Measure(struct Asset* asset, size_t* cpu, size_t* gpu) {
+	*cpu = asset->cpu;
+	*gpu = asset->gpu;
+	if (asset->type == ASSET_BITMAP) {
+		ALLEGRO_BITMAP* bitmap = asset->ptr;
+		int flags = al_get_bitmap_flags(bitmap);
+		size_t bytes = (size_t)al_get_bitmap_width(bitmap) * al_get_bitmap_height(bitmap) * al_get_pixel_size(al_get_bitmap_format(bitmap));
+		if (flags & ALLEGRO_MEMORY_BITMAP) {
+			*cpu += bytes;
+		} else {
+			*gpu = (flags & ALLEGRO_MIPMAP) ? bytes * 4 / 3 : bytes;
+		}
+	}
+}
+
+static size_t GetFileSize(const char* path) {
+	ALLEGRO_FS_ENTRY* entry = al_create_fs_entry(path);
+	size_t size = al_fs_entry_exists(entry) ? al_get_fs_entry_size(entry) : 0;
+	al_destroy_fs_entry(entry);
+	return size;
+}
+
+static size_t EstimateGlyphCache(int size) {
+	size = abs(size); // negative sizes are pixel heights rather than em sizes, close enough
+	size_t cell = (size_t)(size * 0.6 + 2) * (size_t)(size * 1.2 + 2);
+	size_t page = GLYPH_PAGE * GLYPH_PAGE;
+	return (GLYPH_COUNT * cell + page - 1) / page * page * 4;
+}
+
+static size_t GetSampleSize(ALLEGRO_SAMPLE* sample) {
+	return (size_t)al_get_sample_length(sample) * al_get_channel_count(al_get_sample_channels(sample)) * al_get_audio_depth_size(al_get_sample_depth(sample));
+}
+
+static bool ReloadBitmap(struct Game* game, ALLEGRO_BITMAP* bitmap, const char* filename) {
+	// Decodes the file into a memory bitmap and uploads it into the existing one, which the gamestates
+	// keep pointers to.
+	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	ALLEGRO_BITMAP* source = al_load_bitmap(GetDataFilePath(game, filename));
+	al_set_new_bitmap_flags(flags);
+	if (!source) {
+		return false;
+	}
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	if (al_get_bitmap_width(source) != width || al_get_bitmap_height(source) != height) {
+		al_destroy_bitmap(source);
+		return false;
+	}
+	ALLEGRO_LOCKED_REGION* from = al_lock_bitmap(source, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+	ALLEGRO_LOCKED_REGION* to = from ? al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY) : NULL;
+	if (to) {
+		for (int y = 0; y < height; y++) {
+			memcpy((uint8_t*)to->data + y * to->pitch, (uint8_t*)from->data + y * from->pitch, width * 4);
+		}
+		al_unlock_bitmap(bitmap);
+	}
+	if (from) {
+		al_unlock_bitmap(source);
+	}
+	al_destroy_bitmap(source);
+	return to != NULL;
+}
+
+ALLEGRO_BITMAP* LoadBitmapAsset(struct Game* game, const char* owner, const char* filename) {
+	struct AssetRegistry* registry = game->data->assets;
+	int flags = al_get_new_bitmap_flags();
+	if (registry->reload_textures) {
+		al_set_new_bitmap_flags(flags | ALLEGRO_NO_PRESERVE_TEXTURE);
+	}
+	ALLEGRO_BITMAP* bitmap = al_load_bitmap(GetDataFilePath(game, filename));
+	al_set_new_bitmap_flags(flags);
+
+	// nothing gets read back here, so it doesn't matter whether this is a video bitmap already
+	TrackAsset(game, (struct Asset){.ptr = bitmap, .type = ASSET_BITMAP, .owner = owner, .reload = registry->reload_textures}, filename);
+	return bitmap;
+}
+
+ALLEGRO_BITMAP* CreateRenderTarget(struct Game* game, const char* owner, const char* name, ALLEGRO_BITMAP** handle, int width, int height, AssetRecipe* recipe, void* userdata) {
+	// The recipe gets called to redraw the content whenever the target had to be recreated; it may be NULL
+	// when it gets redrawn every frame anyway.
+	*handle = CreateNotPreservedBitmap(width, height);
+	struct Asset asset = {.ptr = *handle, .type = ASSET_BITMAP, .owner = owner};
+	asset.target.handle = handle;
+	asset.target.width = width;
+	asset.target.height = height;
+	asset.target.flags = al_get_new_bitmap_flags();
+	asset.target.recipe = recipe;
+	asset.target.userdata = userdata;
+	TrackAsset(game, asset, name);
+	return *handle;
+}
+
+ALLEGRO_FONT* LoadFontAsset(struct Game* game, const char* owner, const char* filename, int size, int flags) {
+	const char* path = GetDataFilePath(game, filename);
+	ALLEGRO_FONT* font = al_load_font(path, size, flags);
+	char name[64];
+	snprintf(name, sizeof(name), "%s %dpx", filename, abs(size));
+	// FreeType reads the file on demand; counting all of it errs on the safe side
+	Track(game, font, ASSET_FONT, owner, name, GetFileSize(path), EstimateGlyphCache(size), true);
+	return font;
+}
+
+ALLEGRO_SAMPLE* LoadSampleAsset(struct Game* game, const char* owner, const char* filename) {
+	ALLEGRO_SAMPLE* sample = al_load_sample(GetDataFilePath(game, filename));
+	return TrackSample(game, owner, filename, sample);
+}
+
+struct MusicStream* LoadMusicAsset(struct Game* game, const char* owner, const char* filename, ALLEGRO_MIXER* mixer) {
+	struct MusicStream* music = CreateMusicStream(game, GetDataFilePath(game, filename), mixer);
+	if (music) {
+		Track(game, music, ASSET_MUSIC, owner, filename, GetMusicStats(music).memory, 0, false);
+	}
+	return music;
+}
+
+ALLEGRO_BITMAP* TrackBitmap(struct Game* game, const char* owner, const char* name, ALLEGRO_BITMAP* bitmap) {
+	Track(game, bitmap, ASSET_BITMAP, owner, name, 0, 0, false);
+	return bitmap;
+}
+
+ALLEGRO_SAMPLE* TrackSample(struct Game* game, const char* owner, const char* name, ALLEGRO_SAMPLE* sample) {
+	if (sample) {
+		Track(game, sample, ASSET_SAMPLE, owner, name, GetSampleSize(sample), 0, false);
+	}
+	return sample;
+}
+
+void DestroyBitmapAsset(struct Game* game, ALLEGRO_BITMAP* bitmap) {
+	UntrackAsset(game, bitmap);
+	al_destroy_bitmap(bitmap);
+}
+
+void DestroyFontAsset(struct Game* game, ALLEGRO_FONT* font) {
+	UntrackAsset(game, font);
+	al_destroy_font(font);
+}
+
+void DestroySampleAsset(struct Game* game, ALLEGRO_SAMPLE* sample) {
+	UntrackAsset(game, sample);
+	al_destroy_sample(sample);
+}
+
+void DestroyMusicAsset(struct Game* game, struct MusicStream* music) {
+	if (!music) {
+		return;
+	}
+	UntrackAsset(game, music);
+	DestroyMusicStream(music);
+}
+
+static struct LazyAsset* CreateLazyAsset(struct Game* game, enum AssetType type, const char* owner, const char* filename) {
+	struct LazyAsset* asset = calloc(1, sizeof(struct LazyAsset));
+	asset->game = game;
+	asset->type = type;
+	asset->owner = owner;
+	snprintf(asset->filename, sizeof(asset->filename), "%s", filename);
+	struct AssetRegistry* registry = game->data->assets;
+	al_lock_mutex(registry->mutex);
+	asset->next = registry->lazy;
+	registry->lazy = asset;
+	al_unlock_mutex(registry->mutex);
+	return asset;
+}
+
+struct LazyAsset* LazyBitmap(struct Game* game, const char* owner, const char* filename) {
+	return CreateLazyAsset(game, ASSET_BITMAP, owner, filename);
+}
+
+struct LazyAsset* LazyFont(struct Game* game, const char* owner, const char* filename, int size, int flags) {
+	struct LazyAsset* asset = CreateLazyAsset(game, ASSET_FONT, owner, filename);
+	asset->size = size;
+	asset->flags = flags;
+	return asset;
+}
+
+struct LazyAsset* LazySample(struct Game* game, const char* owner, const char* filename) {
+	return CreateLazyAsset(game, ASSET_SAMPLE, owner, filename);
+}
+
+struct LazyAsset* LazyShader(struct Game* game, const char* owner, const char* vertex, const char* pixel) {
+	struct LazyAsset* asset = CreateLazyAsset(game, ASSET_SHADER, owner, pixel);
+	snprintf(asset->vertex, sizeof(asset->vertex), "%s", vertex);
+	return asset;
+}
+
+static void LoadLazyAsset(struct LazyAsset* asset) {
+	struct Game* game = asset->game;
+	switch (asset->type) {
+		case ASSET_BITMAP:
+			asset->ptr = LoadBitmapAsset(game, asset->owner, asset->filename);
+			break;
+		case ASSET_FONT:
+			asset->ptr = LoadFontAsset(game, asset->owner, asset->filename, asset->size, asset->flags);
+			break;
+		case ASSET_SAMPLE:
+			asset->ptr = LoadSampleAsset(game, asset->owner, asset->filename);
+			break;
+		case ASSET_SHADER:
+			asset->ptr = LoadShader(game, GetDataFilePath(game, asset->vertex), GetDataFilePath(game, asset->filename));
+			break;
+		default:
+			break;
+	}
+	if (!asset->ptr) {
+		PrintConsole(game, "Assets: could not load %s %s!", AssetTypeNames[asset->type], asset->filename);
+	}
+}
+
+static void* PrefetchThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct LazyAsset* asset = arg;
+	al_set_new_bitmap_flags(asset->bitmap_flags);
+	LoadLazyAsset(asset);
+	return NULL;
+}
+
+void PrefetchAsset(struct LazyAsset* asset) {
+	// Shaders need the GL context, so they only ever get compiled on first use.
+	if (asset->loaded || asset->prefetch || asset->type == ASSET_SHADER) {
+		return;
+	}
+	asset->bitmap_flags = al_get_new_bitmap_flags();
+	asset->prefetch = al_create_thread(PrefetchThread, asset);
+	if (asset->prefetch) {
+		al_start_thread(asset->prefetch);
+	}
+}
+
+static void FinishLoading(struct LazyAsset* asset) {
+	if (asset->loaded) {
+		return;
+	}
+	if (asset->prefetch) {
+		al_join_thread(asset->prefetch, NULL);
+		al_destroy_thread(asset->prefetch);
+		asset->prefetch = NULL;
+		// without a display on that thread bitmaps end up in memory
+		if (asset->type == ASSET_BITMAP && asset->ptr && (al_get_bitmap_flags(asset->ptr) & ALLEGRO_MEMORY_BITMAP) && !(al_get_new_bitmap_flags() & ALLEGRO_MEMORY_BITMAP)) {
+			int flags = al_get_new_bitmap_flags();
+			if (asset->game->data->assets->reload_textures) {
+				al_set_new_bitmap_flags(flags | ALLEGRO_NO_PRESERVE_TEXTURE);
+			}
+			al_convert_bitmap(asset->ptr);
+			al_set_new_bitmap_flags(flags);
+		}
+	} else {
+		LoadLazyAsset(asset);
+	}
+	asset->loaded = true;
+}
+
+static void* GetLazyAsset(struct LazyAsset* asset, enum AssetType type) {
+	if (asset->type != type) {
+		PrintConsole(asset->game, "Assets: %s is a %s, not a %s!", asset->filename, AssetTypeNames[asset->type], AssetTypeNames[type]);
+		return NULL;
+	}
+	FinishLoading(asset);
+	asset->used = true;
+	return asset->ptr;
+}
+
+ALLEGRO_BITMAP* GetLazyBitmap(struct LazyAsset* asset) {
+	return GetLazyAsset(asset, ASSET_BITMAP);
+}
+
+ALLEGRO_FONT* GetLazyFont(struct LazyAsset* asset) {
+	return GetLazyAsset(asset, ASSET_FONT);
+}
+
+ALLEGRO_SAMPLE* GetLazySample(struct LazyAsset* asset) {
+	return GetLazyAsset(asset, ASSET_SAMPLE);
+}
+
+ALLEGRO_SHADER* GetLazyShader(struct LazyAsset* asset) {
+	return GetLazyAsset(asset, ASSET_SHADER);
+}
+
+void* PeekLazyAsset(struct LazyAsset* asset) {
+	// Returns the asset only if it has been used already, without loading it or counting as a use.
+	return asset->loaded ? asset->ptr : NULL;
+}
+
+void DestroyLazyAsset(struct LazyAsset* asset) {
+	struct Game* game = asset->game;
+	if (asset->prefetch) {
+		FinishLoading(asset);
+	}
+	if (!asset->used) {
+		PrintConsole(game, "Assets: %s %s from %s was never used%s", AssetTypeNames[asset->type], asset->filename, asset->owner,
+			asset->ptr ? ", but got prefetched" : "");
+	}
+	if (asset->ptr) {
+		switch (asset->type) {
+			case ASSET_BITMAP:
+				DestroyBitmapAsset(game, asset->ptr);
+				break;
+			case ASSET_FONT:
+				DestroyFontAsset(game, asset->ptr);
+				break;
+			case ASSET_SAMPLE:
+				DestroySampleAsset(game, asset->ptr);
+				break;
+			case ASSET_SHADER:
+				ReleaseShader(game, asset->ptr);
+				break;
+			default:
+				break;
+		}
+	}
+
+	struct AssetRegistry* registry = game->data->assets;
+	al_lock_mutex(registry->mutex);
+	for (struct LazyAsset** link = &registry->lazy; *link; link = &(*link)->next) {
+		if (*link == asset) {
+			*link = asset->next;
+			break;
+		}
+	}
+	al_unlock_mutex(registry->mutex);
+	free(asset);
+}
+
+static void RestoreAssets(struct AssetRegistry* registry) {
+	// Has to run on the main thread, with the display usable again.
+	struct Game* game = registry->game;
+	double start = al_get_time();
+	al_lock_mutex(registry->mutex);
+	for (int i = 0; i < registry->count; i++) {
+		struct Asset* asset = &registry->assets[i];
+		if (asset->reload) {
+			if (ReloadBitmap(game, asset->ptr, asset->name)) {
+				size_t cpu, gpu;
+				Measure(asset, &cpu, &gpu);
+				registry->recovery.textures++;
+				registry->recovery.bytes += gpu;
+			} else {
+				PrintConsole(game, "Assets: could not reload %s!", asset->name);
+			}
+		} else if (asset->target.handle) {
+			int flags = al_get_new_bitmap_flags();
+			al_set_new_bitmap_flags(asset->target.flags);
+			ALLEGRO_BITMAP* bitmap = CreateNotPreservedBitmap(asset->target.width, asset->target.height);
+			al_set_new_bitmap_flags(flags);
+			if (!bitmap) {
+				continue;
+			}
+			al_destroy_bitmap(asset->ptr);
+			asset->ptr = bitmap;
+			*asset->target.handle = bitmap;
+			if (asset->target.recipe) {
+				asset->target.recipe(game, bitmap, asset->target.userdata);
+			}
+			registry->recovery.targets++;
+		}
+	}
+	al_unlock_mutex(registry->mutex);
+	SetFramebufferAsTarget(game);
+	registry->recovery.duration = al_get_time() - start;
+}
+
+void BeginDisplayRecovery(struct AssetRegistry* registry, const char* reason, bool lost) {
+	// With lost set, everything gets restored before the next frame. Either way, the time until that
+	// frame is done gets reported.
+	registry->recovery.reason = reason;
+	registry->recovery.lost = registry->recovery.lost || lost;
+	registry->recovery.restored = false;
+	registry->recovery.start = al_get_time();
+}
+
+void AssetRegistryPreDraw(struct AssetRegistry* registry) {
+	if (registry->recovery.lost) {
+		RestoreAssets(registry);
+		registry->recovery.lost = false;
+		registry->recovery.restored = true;
+	}
+}
+
+void AssetRegistryPostDraw(struct AssetRegistry* registry) {
+	if (!registry->recovery.reason) {
+		return;
+	}
+	double time = al_get_time() - registry->recovery.start;
+	if (registry->recovery.restored) {
+		PrintConsole(registry->game, "Assets: recovered from %s in %.1f ms, of which %.1f ms restoring %d textures (%.1f MB) and %d render targets",
+			registry->recovery.reason, time * 1000.0, registry->recovery.duration * 1000.0, registry->recovery.textures,
+			registry->recovery.bytes / MEGABYTE, registry->recovery.targets);
+	} else {
+		PrintConsole(registry->game, "Assets: recovered from %s in %.1f ms", registry->recovery.reason, time * 1000.0);
+	}
+	registry->recovery.reason = NULL;
+	registry->recovery.restored = false;
+	registry->recovery.textures = registry->recovery.targets = 0;
+	registry->recovery.bytes = 0;
+}
+
+static struct AssetUsage Sum(struct AssetRegistry* registry, const char* owner) {
+	struct AssetUsage usage = {0};
+	for (int i = 0; i < registry->count; i++) {
+		if (owner && strcmp(registry->assets[i].owner, owner) != 0) {
+			continue;
+		}
+		size_t cpu, gpu;
+		Measure(&registry->assets[i], &cpu, &gpu);
+		usage.cpu += cpu;
+		usage.gpu += gpu;
+	}
+	return usage;
+}
+
+struct AssetUsage GetAssetUsage(struct AssetRegistry* registry, const char* owner) {
+	// Pass NULL for the total of all gamestates.
+	al_lock_mutex(registry->mutex);
+	struct AssetUsage usage = Sum(registry, owner);
+	al_unlock_mutex(registry->mutex);
+	return usage;
+}
+
+static bool IsFirstOfOwner(struct AssetRegistry* registry, int index) {
+	for (int i = 0; i < index; i++) {
+		if (strcmp(registry->assets[i].owner, registry->assets[index].owner) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void WarnOverBudget(struct AssetRegistry* registry, const char* what, const char* kind, size_t used, size_t budget) {
+	if (budget && used > budget) {
+		PrintConsole(registry->game, "Assets: WARNING: %s uses %.1f MB of %s, over the budget of %.1f MB", what, used / MEGABYTE, kind, budget / MEGABYTE);
+	}
+}
+
+void CheckAssetBudgets(struct AssetRegistry* registry) {
+	// Cheap to call every frame; only does any work after assets got loaded or released.
+	al_lock_mutex(registry->mutex);
+	if (!registry->dirty) {
+		al_unlock_mutex(registry->mutex);
+		return;
+	}
+	registry->dirty = false;
+
+	struct AssetUsage total = Sum(registry, NULL);
+	WarnOverBudget(registry, "everything", "RAM", total.cpu, registry->ram_budget);
+	WarnOverBudget(registry, "everything", "VRAM", total.gpu, registry->vram_budget);
+	for (int i = 0; i < registry->count; i++) {
+		if (!IsFirstOfOwner(registry, i)) {
+			continue;
+		}
+		const char* owner = registry->assets[i].owner;
+		char key[64];
+		struct AssetUsage usage = Sum(registry, owner);
+		snprintf(key, sizeof(key), "%s_ram_budget", owner);
+		WarnOverBudget(registry, owner, "RAM", usage.cpu, GetBudget(registry->game, key, "0"));
+		snprintf(key, sizeof(key), "%s_vram_budget", owner);
+		WarnOverBudget(registry, owner, "VRAM", usage.gpu, GetBudget(registry->game, key, "0"));
+	}
+	al_unlock_mutex(registry->mutex);
+}
+
+struct AssetRow {
+	struct Asset* asset;
+	size_t cpu, gpu;
+};
+
+static int CompareRows(const void* a, const void* b) {
+	size_t x = ((const struct AssetRow*)a)->cpu + ((const struct AssetRow*)a)->gpu;
+	size_t y = ((const struct AssetRow*)b)->cpu + ((const struct AssetRow*)b)->gpu;
+	return (x < y) - (x > y);
+}
+
+void DumpAssets(struct AssetRegistry* registry) {
+	struct Game* game = registry->game;
+	al_lock_mutex(registry->mutex);
+	struct AssetRow* rows = calloc(registry->count ? registry->count : 1, sizeof(struct AssetRow));
+	for (int i = 0; i < registry->count; i++) {
+		rows[i].asset = &registry->assets[i];
+		Measure(rows[i].asset, &rows[i].cpu, &rows[i].gpu);
+	}
+	qsort(rows, registry->count, sizeof(struct AssetRow), CompareRows);
+
+	PrintConsole(game, "Assets (~ marks estimates):");
+	PrintConsole(game, "  %-36s %-10s %-6s %10s %10s", "name", "gamestate", "type", "RAM KB", "VRAM KB");
+	for (int i = 0; i < registry->count; i++) {
+		struct Asset* asset = rows[i].asset;
+		PrintConsole(game, "%c %-36s %-10s %-6s %10.1f %10.1f", asset->estimate ? '~' : ' ', asset->name, asset->owner,
+			AssetTypeNames[asset->type], rows[i].cpu / 1024.0, rows[i].gpu / 1024.0);
+	}
+	for (int i = 0; i < registry->count; i++) {
+		if (IsFirstOfOwner(registry, i)) {
+			struct AssetUsage usage = Sum(registry, registry->assets[i].owner);
+			PrintConsole(game, "  %-10s %7.1f MB RAM %7.1f MB VRAM", registry->assets[i].owner, usage.cpu / MEGABYTE, usage.gpu / MEGABYTE);
+		}
+	}
+	for (struct LazyAsset* asset = registry->lazy; asset; asset = asset->next) {
+		if (!asset->used) {
+			PrintConsole(game, "  not used so far: %s %s from %s", AssetTypeNames[asset->type], asset->filename, asset->owner);
+		}
+	}
+	struct AssetUsage total = Sum(registry, NULL);
+	PrintConsole(game, "  %-10s %7.1f MB RAM %7.1f MB VRAM (budgets: %.0f MB, %.0f MB)", "total", total.cpu / MEGABYTE, total.gpu / MEGABYTE,
+		registry->ram_budget / MEGABYTE, registry->vram_budget / MEGABYTE);
+	free(rows);
+	al_unlock_mutex(registry->mutex);
+}
@@ -0,0 +1,77 @@
+/*! \file assets.h
+ *  \brief Asset memory accounting.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_ASSETS_H
+#define SECRETSANTA_ASSETS_H
+
+#include <libsuperderpy.h>
+
+struct MusicStream;
+struct AssetRegistry;
+struct LazyAsset;
+
+/*! \brief Redraws the content of a render target that had to be recreated. */
+typedef void AssetRecipe(struct Game* game, ALLEGRO_BITMAP* target, void* userdata);
+
+struct AssetUsage {
+	size_t cpu, gpu; // in bytes
+};
+
+struct AssetRegistry* CreateAssetRegistry(struct Game* game);
+void DestroyAssetRegistry(struct AssetRegistry* registry);
+
+// The owner is the name of the gamestate holding the asset; filenames are relative to the data directory.
+ALLEGRO_BITMAP* LoadBitmapAsset(struct Game* game, const char* owner, const char* filename);
+ALLEGRO_FONT* LoadFontAsset(struct Game* game, const char* owner, const char* filename, int size, int flags);
+ALLEGRO_SAMPLE* LoadSampleAsset(struct Game* game, const char* owner, const char* filename);
+struct MusicStream* LoadMusicAsset(struct Game* game, const char* owner, const char* filename, ALLEGRO_MIXER* mixer);
+
+// For assets created in code rather than loaded from a file.
+ALLEGRO_BITMAP* CreateRenderTarget(struct Game* game, const char* owner, const char* name, ALLEGRO_BITMAP** handle, int width, int height, AssetRecipe* recipe, void* userdata);
+ALLEGRO_BITMAP* TrackBitmap(struct Game* game, const char* owner, const char* name, ALLEGRO_BITMAP* bitmap);
+ALLEGRO_SAMPLE* TrackSample(struct Game* game, const char* owner, const char* name, ALLEGRO_SAMPLE* sample);
+void UntrackAsset(struct Game* game, void* asset);
+
+void DestroyBitmapAsset(struct Game* game, ALLEGRO_BITMAP* bitmap);
+void DestroyFontAsset(struct Game* game, ALLEGRO_FONT* font);
+void DestroySampleAsset(struct Game* game, ALLEGRO_SAMPLE* sample);
+void DestroyMusicAsset(struct Game* game, struct MusicStream* music);
+
+// Handles that only load the asset the first time it's asked for. Get* may only be called from the main thread.
+struct LazyAsset* LazyBitmap(struct Game* game, const char* owner, const char* filename);
+struct LazyAsset* LazyFont(struct Game* game, const char* owner, const char* filename, int size, int flags);
+struct LazyAsset* LazySample(struct Game* game, const char* owner, const char* filename);
+struct LazyAsset* LazyShader(struct Game* game, const char* owner, const char* vertex, const char* pixel);
+void PrefetchAsset(struct LazyAsset* asset);
+ALLEGRO_BITMAP* GetLazyBitmap(struct LazyAsset* asset);
+ALLEGRO_FONT* GetLazyFont(struct LazyAsset* asset);
+ALLEGRO_SAMPLE* GetLazySample(struct LazyAsset* asset);
+ALLEGRO_SHADER* GetLazyShader(struct LazyAsset* asset);
+void* PeekLazyAsset(struct LazyAsset* asset);
+void DestroyLazyAsset(struct LazyAsset* asset);
+
+struct AssetUsage GetAssetUsage(struct AssetRegistry* registry, const char* owner);
+void CheckAssetBudgets(struct AssetRegistry* registry);
+void DumpAssets(struct AssetRegistry* registry);
+void BeginDisplayRecovery(struct AssetRegistry* registry, const char* reason, bool lost);
+void AssetRegistryPreDraw(struct AssetRegistry* registry);
+void AssetRegistryPostDraw(struct AssetRegistry* registry);
+
+#endif
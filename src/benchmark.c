@@ -0,0 +1,295 @@
+/*! \file benchmark.c
+ *  \brief Headless render benchmark.
+ *
+ *  Only compiled in with -DRENDER_BENCHMARK=ON. With --bench-render, the
+ *  gamestates show a fixed sequence of frozen scenes (the intro, the title
+ *  screen, each hand-made level and a generated level with lots of drones)
+ *  and draw them into an offscreen 3840x2160 bitmap, no matter the size of
+ *  the window. Every scene is drawn for a number of
+ *  warm-up frames and then measured: time spent issuing the draw calls, time
+ *  until the GPU is done with them, and the number of GL draw calls made.
+ *  The last frame of every scene is compared against a reference image in
+ *  data/golden; a scene without one fails.
+ *
+ *  It's meant to be run on a software GL stack without a GPU, e.g.:
+ *
+ *    LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe \
+ *      xvfb-run ./secretsanta --bench-render
+ *
+ *  Reference images are stored with --update-golden, using the same stack.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef RENDER_BENCHMARK
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for RTLD_NEXT
+#endif
+
+#include "benchmark.h"
+#include <allegro5/allegro_opengl.h>
+#include <dlfcn.h>
+#include <libsuperderpy.h>
+
+#define WARMUP_FRAMES 30
+#define MEASURED_FRAMES 120
+
+static const char* SceneNames[BENCHMARK_SCENES] = {
+	[BENCHMARK_DOSOWISKO] = "dosowisko",
+	[BENCHMARK_TITLE] = "title",
+	[BENCHMARK_LEVEL0] = "level0",
+	[BENCHMARK_LEVEL1] = "level1",
+	[BENCHMARK_LEVEL2] = "level2",
+	[BENCHMARK_LEVEL3] = "level3",
+	[BENCHMARK_GENERATED] = "generated",
+};
+
+static struct {
+	bool enabled;
+	struct RenderBenchmarkConfig config;
+	int scene, frame;
+	double start, cpu[MEASURED_FRAMES], gpu[MEASURED_FRAMES];
+	int calls[MEASURED_FRAMES];
+	int failures;
+
+	ALLEGRO_BITMAP *target, *previous;
+	ALLEGRO_TRANSFORM transform, projection;
+	int clip_x, clip_y, clip_w, clip_h;
+} bench = {.scene = -1};
+
+// Allegro issues all of its drawing through these, so wrapping them counts the draw calls
+// no matter which addon they came from.
+static int draw_calls = 0;
+
+void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+	static void (*real)(GLenum, GLint, GLsizei) = NULL;
+	if (!real) {
+		real = (void (*)(GLenum, GLint, GLsizei))dlsym(RTLD_NEXT, "glDrawArrays");
+	}
+	draw_calls++;
+	real(mode, first, count);
+}
+
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+	static void (*real)(GLenum, GLsizei, GLenum, const void*) = NULL;
+	if (!real) {
+		real = (void (*)(GLenum, GLsizei, GLenum, const void*))dlsym(RTLD_NEXT, "glDrawElements");
+	}
+	draw_calls++;
+	real(mode, count, type, indices);
+}
+
+void InitRenderBenchmark(struct Game* game, struct RenderBenchmarkConfig config) {
+	bench.enabled = true;
+	bench.config = config;
+	bench.scene = 0;
+	bench.frame = 0;
+
+	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP);
+	bench.target = al_create_bitmap(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+	al_set_new_bitmap_flags(flags);
+	printf("Render benchmark, %d warm-up and %d measured frames per scene\n", WARMUP_FRAMES, MEASURED_FRAMES);
+	printf("%-10s %9s %9s %9s %9s %7s  %s\n", "scene", "cpu avg", "gpu avg", "gpu p95", "gpu max", "calls", "reference");
+}
+
+int GetRenderBenchmarkScene(void) {
+	return bench.enabled ? bench.scene : -1;
+}
+
+void RenderBenchmarkPreDraw(struct Game* game) {
+	if (!bench.enabled || !bench.target) {
+		return;
+	}
+	glFinish(); // don't let the previous frame's work leak into this one
+	draw_calls = 0;
+	bench.start = al_get_time();
+
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(bench.target);
+	al_clear_to_color(al_map_rgb(0, 0, 0));
+	al_set_target_bitmap(target);
+}
+
+void BeginBenchmarkDraw(struct Game* game) {
+	// Redirects the drawing of a gamestate into the offscreen target, with the viewport stretched over all of it.
+	if (!bench.enabled || !bench.target) {
+		return;
+	}
+	bench.previous = al_get_target_bitmap();
+	al_copy_transform(&bench.transform, al_get_current_transform());
+	al_copy_transform(&bench.projection, al_get_current_projection_transform());
+	al_get_clipping_rectangle(&bench.clip_x, &bench.clip_y, &bench.clip_w, &bench.clip_h);
+
+	al_set_target_bitmap(bench.target);
+	ALLEGRO_TRANSFORM transform, projection;
+	al_identity_transform(&transform);
+	al_scale_transform(&transform, BENCHMARK_WIDTH / (float)game->viewport.width, BENCHMARK_HEIGHT / (float)game->viewport.height);
+	al_use_transform(&transform);
+	al_identity_transform(&projection);
+	al_orthographic_transform(&projection, 0, 0, -1, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 1);
+	al_use_projection_transform(&projection);
+	al_set_clipping_rectangle(0, 0, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+}
+
+void EndBenchmarkDraw(struct Game* game) {
+	if (!bench.enabled || !bench.target) {
+		return;
+	}
+	al_set_target_bitmap(bench.previous);
+	al_use_transform(&bench.transform);
+	al_use_projection_transform(&bench.projection);
+	al_set_clipping_rectangle(bench.clip_x, bench.clip_y, bench.clip_w, bench.clip_h);
+}
+
+static int CompareTimes(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void CheckReference(ALLEGRO_BITMAP* frame, char* result, size_t size) {
+	// Compares the frame with the reference image, or stores it as the reference with --update-golden.
+	ALLEGRO_PATH* path = al_create_path_for_directory(bench.config.golden);
+	al_set_path_filename(path, SceneNames[bench.scene]);
+	al_set_path_extension(path, ".png");
+	const char* filename = al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP);
+
+	if (bench.config.update) {
+		al_make_directory(bench.config.golden);
+		bool saved = al_save_bitmap(filename, frame);
+		al_destroy_path(path);
+		if (!saved) {
+			bench.failures++;
+		}
+		snprintf(result, size, "%s", saved ? "saved" : "FAILED: could not save");
+		return;
+	}
+
+	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	ALLEGRO_BITMAP* golden = al_load_bitmap(filename);
+	al_set_new_bitmap_flags(flags);
+	al_destroy_path(path);
+
+	if (!golden) {
+		snprintf(result, size, "FAILED: no reference, run with --update-golden");
+		bench.failures++;
+		return;
+	}
+	int width = al_get_bitmap_width(frame), height = al_get_bitmap_height(frame);
+	if (al_get_bitmap_width(golden) != width || al_get_bitmap_height(golden) != height) {
+		snprintf(result, size, "FAILED: size %dx%d, expected %dx%d", width, height, al_get_bitmap_width(golden), al_get_bitmap_height(golden));
+		al_destroy_bitmap(golden);
+		bench.failures++;
+		return;
+	}
+
+	ALLEGRO_LOCKED_REGION* a = al_lock_bitmap(frame, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READONLY);
+	ALLEGRO_LOCKED_REGION* b = al_lock_bitmap(golden, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READONLY);
+	long different = 0;
+	int worst = 0;
+	for (int y = 0; y < height; y++) {
+		const uint8_t* row_a = (const uint8_t*)a->data + y * a->pitch;
+		const uint8_t* row_b = (const uint8_t*)b->data + y * b->pitch;
+		for (int x = 0; x < width; x++) {
+			int diff = 0;
+			for (int c = 0; c < 3; c++) {
+				int d = abs(row_a[x * 4 + c] - row_b[x * 4 + c]);
+				diff = (d > diff) ? d : diff;
+			}
+			worst = (diff > worst) ? diff : worst;
+			if (diff > bench.config.threshold) {
+				different++;
+			}
+		}
+	}
+	al_unlock_bitmap(frame);
+	al_unlock_bitmap(golden);
+	al_destroy_bitmap(golden);
+
+	double fraction = different / (double)(width * height);
+	bool ok = fraction <= bench.config.tolerance;
+	if (!ok) {
+		bench.failures++;
+	}
+	snprintf(result, size, "%s: %.3f%% pixels differ, max difference %d", ok ? "ok" : "FAILED", fraction * 100.0, worst);
+}
+
+static void ReportScene(struct Game* game) {
+	double cpu = 0, gpu = 0, calls = 0, sorted[MEASURED_FRAMES];
+	for (int i = 0; i < MEASURED_FRAMES; i++) {
+		cpu += bench.cpu[i];
+		gpu += bench.gpu[i];
+		calls += bench.calls[i];
+		sorted[i] = bench.gpu[i];
+	}
+	qsort(sorted, MEASURED_FRAMES, sizeof(double), CompareTimes);
+
+	char result[128];
+	CheckReference(bench.target, result, sizeof(result));
+	printf("%-10s %6.2f ms %6.2f ms %6.2f ms %6.2f ms %7.1f  %s\n", SceneNames[bench.scene],
+		cpu / MEASURED_FRAMES * 1000.0, gpu / MEASURED_FRAMES * 1000.0, sorted[MEASURED_FRAMES * 95 / 100] * 1000.0,
+		sorted[MEASURED_FRAMES - 1] * 1000.0, calls / MEASURED_FRAMES, result);
+	fflush(stdout);
+}
+
+bool RenderBenchmarkPostDraw(struct Game* game) {
+	// Returns true once all the scenes are done.
+	if (!bench.enabled) {
+		return false;
+	}
+	double cpu = al_get_time() - bench.start;
+	glFinish();
+	double gpu = al_get_time() - bench.start;
+
+	int measured = bench.frame - WARMUP_FRAMES;
+	if (measured >= 0) {
+		bench.cpu[measured] = cpu;
+		bench.gpu[measured] = gpu;
+		bench.calls[measured] = draw_calls;
+	}
+	bench.frame++;
+	if (measured == MEASURED_FRAMES - 1) {
+		ReportScene(game);
+		bench.scene++;
+		bench.frame = 0;
+	}
+	if (bench.scene >= BENCHMARK_SCENES && bench.target) {
+		al_destroy_bitmap(bench.target);
+		bench.target = NULL;
+	}
+	return bench.scene >= BENCHMARK_SCENES;
+}
+
+int FinishRenderBenchmark(void) {
+	// Returns the number of scenes that didn't match their reference image.
+	if (!bench.enabled) {
+		return 0;
+	}
+	bench.enabled = false;
+	if (bench.scene < BENCHMARK_SCENES) {
+		fprintf(stderr, "Render benchmark FAILED: quit after %d of %d scenes\n", bench.scene, BENCHMARK_SCENES);
+		return 1;
+	}
+	if (bench.failures) {
+		fprintf(stderr, "Render benchmark FAILED: %d of %d scenes\n", bench.failures, BENCHMARK_SCENES);
+	}
+	return bench.failures;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*! \file benchmark.h
+ *  \brief Headless render benchmark.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_BENCHMARK_H
+#define SECRETSANTA_BENCHMARK_H
+
+#include <libsuperderpy.h>
+
+enum BenchmarkScene {
+	BENCHMARK_DOSOWISKO,
+	BENCHMARK_TITLE,
+	BENCHMARK_LEVEL0,
+	BENCHMARK_LEVEL1,
+	BENCHMARK_LEVEL2,
+	BENCHMARK_LEVEL3,
+	BENCHMARK_GENERATED,
+	BENCHMARK_SCENES
+};
+
+#define BENCHMARK_GENERATED_LEVEL 199 // 200 drones
+#define BENCHMARK_WIDTH 3840
+#define BENCHMARK_HEIGHT 2160
+
+struct RenderBenchmarkConfig {
+	const char* golden; // directory with the reference images
+	bool update; // store the rendered frames as the new reference
+	int threshold; // per channel difference that makes a pixel count as different
+	double tolerance; // fraction of different pixels that still passes
+};
+
+#ifdef RENDER_BENCHMARK
+
+void InitRenderBenchmark(struct Game* game, struct RenderBenchmarkConfig config);
+int GetRenderBenchmarkScene(void);
+void RenderBenchmarkPreDraw(struct Game* game);
+void BeginBenchmarkDraw(struct Game* game);
+void EndBenchmarkDraw(struct Game* game);
+bool RenderBenchmarkPostDraw(struct Game* game);
+int FinishRenderBenchmark(void);
+
+#else
+
+static inline void InitRenderBenchmark(struct Game* game, struct RenderBenchmarkConfig config) {}
+static inline int GetRenderBenchmarkScene(void) { return -1; }
+static inline void RenderBenchmarkPreDraw(struct Game* game) {}
+static inline void BeginBenchmarkDraw(struct Game* game) {}
+static inline void EndBenchmarkDraw(struct Game* game) {}
+static inline bool RenderBenchmarkPostDraw(struct Game* game) { return false; }
+static inline int FinishRenderBenchmark(void) { return 0; }
+
+#endif
+
+#endif
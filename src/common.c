@@ -22,22 +22,74 @@
 #include <libsuperderpy.h>
 
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* ev) {
+	// the engine hands the event to the gamestates right after, so their ProcessEvent gets counted as well
+	SetAllocationPhase(ALLOC_PHASE_EVENT);
+
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_M)) {
 		ToggleMute(game);
 	}
 
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F)) {
+		BeginDisplayRecovery(game->data->assets, "fullscreen toggle", false);
 		ToggleFullscreen(game);
 	}
 
+	if ((ev->type == ALLEGRO_EVENT_DISPLAY_RESUME_DRAWING) || (ev->type == ALLEGRO_EVENT_DISPLAY_FOUND)) {
+		BeginDisplayRecovery(game->data->assets, "display loss", true);
+	}
+
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F9)) {
+		DumpAssets(game->data->assets);
+	}
+
 	return false;
 }
 
+void PreLogic(struct Game* game, double delta) {
+	StartupBenchmarkPreLogic(game);
+	FrameSchedulerPreLogic(game, delta);
+	BeginAllocationFrame();
+	SetAllocationPhase(ALLOC_PHASE_LOGIC);
+}
+
+void PostLogic(struct Game* game, double delta) {
+	UpdateSoundPool(game->data->sounds, delta);
+	CheckAssetBudgets(game->data->assets);
+	SetAllocationPhase(ALLOC_PHASE_ENGINE);
+}
+
+void PreDraw(struct Game* game) {
+	SetAllocationPhase(ALLOC_PHASE_DRAW);
+	AssetRegistryPreDraw(game->data->assets);
+	RenderBenchmarkPreDraw(game);
+}
+
+void PostDraw(struct Game* game) {
+	SetAllocationPhase(ALLOC_PHASE_ENGINE);
+	bool finished = RenderBenchmarkPostDraw(game);
+	finished = StartupBenchmarkPostDraw(game) || finished;
+	AssetRegistryPostDraw(game->data->assets);
+	FrameSchedulerPostDraw(game);
+	if (EndAllocationFrame() || finished) {
+		UnloadAllGamestates(game);
+	}
+}
+
 struct CommonResources* CreateGameData(struct Game* game) {
 	struct CommonResources* data = calloc(1, sizeof(struct CommonResources));
+	data->assets = CreateAssetRegistry(game);
+	data->jobs = CreateJobSystem(strtol(GetConfigOptionDefault(game, "Game", "threads", "0"), NULL, 10));
+	data->scheduler = CreateFrameScheduler(game);
+	data->shaders = CreateShaderCache(game);
+	data->sounds = CreateSoundPool(game, game->audio.fx, strtol(GetConfigOptionDefault(game, "Audio", "voices", "16"), NULL, 10));
 	return data;
 }
 
 void DestroyGameData(struct Game* game) {
+	DestroyJobSystem(game->data->jobs);
+	DestroyFrameScheduler(game->data->scheduler);
+	DestroyShaderCache(game->data->shaders);
+	DestroySoundPool(game->data->sounds);
+	DestroyAssetRegistry(game->data->assets);
 	free(game->data);
 }
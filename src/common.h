@@ -18,11 +18,35 @@
 #define LIBSUPERDERPY_DATA_TYPE struct CommonResources
 #include <libsuperderpy.h>
 
+#include "alloctrack.h"
+#include "assets.h"
+#include "benchmark.h"
+#include "input.h"
+#include "jobs.h"
+#include "music.h"
+#include "netplay.h"
+#include "particles.h"
+#include "resolution.h"
+#include "scheduler.h"
+#include "shaders.h"
+#include "sounds.h"
+#include "startup.h"
+#include "timeline.h"
+#include "world.h"
+
 struct CommonResources {
 	// Fill in with common data accessible from all gamestates.
-	bool unused;
+	struct AssetRegistry* assets;
+	struct JobSystem* jobs;
+	struct FrameScheduler* scheduler;
+	struct ShaderCache* shaders;
+	struct SoundPool* sounds;
 };
 
 struct CommonResources* CreateGameData(struct Game* game);
 void DestroyGameData(struct Game* game);
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* ev);
+void PreLogic(struct Game* game, double delta);
+void PostLogic(struct Game* game, double delta);
+void PreDraw(struct Game* game);
+void PostDraw(struct Game* game);
@@ -24,20 +24,24 @@
 
 #define NEXT_GAMESTATE "game"
 #define SKIP_GAMESTATE NEXT_GAMESTATE
+#define BENCHMARK_TAN 192 // where the zoom ends up once the fade-in is over
+#define TIMELINE_CAPACITY 16 // eleven entries queued in Gamestate_Start
 
 struct GamestateResources {
 	ALLEGRO_FONT* font;
 	ALLEGRO_SAMPLE *sample, *kbd_sample, *key_sample;
-	ALLEGRO_SAMPLE_INSTANCE *sound, *kbd, *key;
-	ALLEGRO_BITMAP *bitmap, *checkerboard, *pixelator;
+	ALLEGRO_SAMPLE_INSTANCE* sound;
+	SoundHandle kbd, key;
+	ALLEGRO_BITMAP* bitmap;
+	ALLEGRO_SHADER* shader;
 	int pos;
-	double fade, tan;
-	char text[255];
+	double fade, tan, next_key;
+	char text[255], drawn[255];
 	bool underscore, fadeout;
-	struct Timeline* timeline;
+	struct FixedTimeline* timeline;
 };
 
-int Gamestate_ProgressCount = 5;
+int Gamestate_ProgressCount = 6;
 
 static const char* text = "# dosowisko.net";
 
@@ -73,28 +77,75 @@ static TM_ACTION(End) {
 
 static TM_ACTION(Play) {
 	TM_RunningOnly;
-	al_play_sample_instance(TM_Arg(0));
+	SoundHandle* handle = TM_Arg(1);
+	*handle = PlaySoundEffect(game->data->sounds, TM_Arg(0), SOUND_PARAMS(.priority = SOUND_PRIORITY_UI));
 	return TM_END;
 }
 
 static TM_ACTION(Type) {
-	TM_RunningOnly;
-	strncpy(data->text, text, data->pos++);
-	data->text[data->pos] = 0;
-	if (strcmp(data->text, text) != 0) {
-		TM_AddBackgroundAction(data->timeline, Type, NULL, (60 + rand() % 60) / 1000.0);
-	} else {
-		al_stop_sample_instance(data->kbd);
+	// a single action types the whole text, so it takes one timeline slot instead of one per key
+	switch (action->state) {
+		case TM_ACTIONSTATE_START:
+			data->next_key = 0;
+			return TM_REPEAT;
+		case TM_ACTIONSTATE_RUNNING:
+			data->next_key -= action->delta;
+			if (data->next_key > 0) {
+				return TM_REPEAT;
+			}
+			strncpy(data->text, text, data->pos++);
+			data->text[data->pos] = 0;
+			if (strcmp(data->text, text) == 0) {
+				StopSoundEffect(game->data->sounds, data->kbd);
+				return TM_END;
+			}
+			data->next_key = (60 + rand() % 60) / 1000.0;
+			return TM_REPEAT;
+		case TM_ACTIONSTATE_DESTROY:
+			return TM_END;
+		default:
+			return TM_REPEAT;
 	}
-	return TM_END;
 }
 //==================================Timeline manager actions END
 
+static void ShowBenchmarkScene(struct Game* game, struct GamestateResources* data, int scene) {
+	// Frozen with the whole text typed out, right after the fade-in.
+	if (scene != BENCHMARK_DOSOWISKO) {
+		if (!data->fadeout) {
+			data->fadeout = true;
+			SwitchCurrentGamestate(game, NEXT_GAMESTATE);
+		}
+		return;
+	}
+	strncpy(data->text, text, 255);
+	data->fade = 255;
+	data->tan = BENCHMARK_TAN;
+	data->underscore = true;
+}
+
 void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	TM_Process(data->timeline, delta);
+	int scene = GetRenderBenchmarkScene();
+	if (scene >= 0) {
+		ShowBenchmarkScene(game, data, scene);
+		return;
+	}
+	ProcessFixedTimeline(data->timeline, delta);
 	data->underscore = Fract(game->time) >= 0.5;
 }
 
+static void DrawTextLayer(struct Game* game, ALLEGRO_BITMAP* target, void* userdata) {
+	// Also the recipe for recreating the layer after the display got lost.
+	struct GamestateResources* data = userdata;
+	al_set_target_bitmap(target);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+	al_draw_text(data->font, al_map_rgba(255, 255, 255, 10), 320 / 2.0,
+		180 * 0.4167, ALLEGRO_ALIGN_CENTRE, data->drawn);
+
+	SetFramebufferAsTarget(game);
+}
+
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	if (!data->fadeout) {
 		char t[255] = "";
@@ -105,53 +156,46 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 			strncat(t, " ", 2);
 		}
 
-		al_set_target_bitmap(data->bitmap);
-		al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-
-		al_draw_text(data->font, al_map_rgba(255, 255, 255, 10), 320 / 2.0,
-			180 * 0.4167, ALLEGRO_ALIGN_CENTRE, t);
+		// the text only changes a few times per second, so it's cached between frames
+		if (strcmp(t, data->drawn) != 0) {
+			strncpy(data->drawn, t, 255);
+			DrawTextLayer(game, data->bitmap, data);
+		}
 
+		BeginBenchmarkDraw(game);
 		double tg = tan(-data->tan / 384.0 * ALLEGRO_PI - ALLEGRO_PI / 2);
 
-		int fade = data->fadeout ? 255 : (int)(data->fade);
-
-		al_set_target_bitmap(data->pixelator);
-		al_clear_to_color(al_map_rgb(35, 31, 32));
-
-		al_draw_tinted_scaled_bitmap(data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0,
-			al_get_bitmap_width(data->bitmap), al_get_bitmap_height(data->bitmap),
-			-tg * al_get_bitmap_width(data->bitmap) * 0.05,
-			-tg * al_get_bitmap_height(data->bitmap) * 0.05,
-			al_get_bitmap_width(data->bitmap) + tg * 0.1 * al_get_bitmap_width(data->bitmap),
-			al_get_bitmap_height(data->bitmap) + tg * 0.1 * al_get_bitmap_height(data->bitmap),
-			0);
-
-		al_draw_bitmap(data->checkerboard, 0, 0, 0);
-
-		SetFramebufferAsTarget(game);
-
-		al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, game->viewport.width, game->viewport.height, 0);
+		// zoom, fade, checkerboard and pixelated upscale all happen in a single pass
+		float resolution[2] = {320, 180};
+		al_use_shader(data->shader);
+		al_set_shader_float_vector("resolution", 2, resolution, 1);
+		al_set_shader_float("zoom", tg);
+		al_set_shader_float("fade", fmin(data->fade, 255) / 255.0);
+		al_draw_scaled_bitmap(data->bitmap, 0, 0, 320, 180, 0, 0, game->viewport.width, game->viewport.height, 0);
+		al_use_shader(NULL);
+		EndBenchmarkDraw(game);
 	}
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
+	EnterAllocationGamestate("dosowisko");
 	data->pos = 1;
 	data->fade = 0;
 	data->tan = 64;
 	data->fadeout = false;
 	data->underscore = true;
 	strncpy(data->text, "#", 255);
-	TM_AddDelay(data->timeline, 0.3);
-	TM_AddQueuedBackgroundAction(data->timeline, FadeIn, NULL, 0);
-	TM_AddDelay(data->timeline, 1.5);
-	TM_AddNamedAction(data->timeline, Play, TM_Args(data->kbd), "PlayKbd");
-	TM_AddQueuedBackgroundAction(data->timeline, Type, NULL, 0);
-	TM_AddDelay(data->timeline, 3.2);
-	TM_AddNamedAction(data->timeline, Play, TM_Args(data->key), "PlayKey");
-	TM_AddDelay(data->timeline, 0.05);
-	TM_AddAction(data->timeline, FadeOut, NULL);
-	TM_AddDelay(data->timeline, 1.0);
-	TM_AddAction(data->timeline, End, NULL);
+	AddFixedDelay(data->timeline, 0.3);
+	AddFixedBackgroundAction(data->timeline, FadeIn, "FadeIn", 0, 0);
+	AddFixedDelay(data->timeline, 1.5);
+	AddFixedAction(data->timeline, Play, "PlayKbd", 2, data->kbd_sample, &data->kbd);
+	AddFixedBackgroundAction(data->timeline, Type, "Type", 0, 0);
+	AddFixedDelay(data->timeline, 3.2);
+	AddFixedAction(data->timeline, Play, "PlayKey", 2, data->key_sample, &data->key);
+	AddFixedDelay(data->timeline, 0.05);
+	AddFixedAction(data->timeline, FadeOut, "FadeOut", 0);
+	AddFixedDelay(data->timeline, 1.0);
+	AddFixedAction(data->timeline, End, "End", 0);
 	al_play_sample_instance(data->sound);
 }
 
@@ -163,36 +207,35 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 }
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
+	progress = TimeLoadingSteps("dosowisko", progress);
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags & ~ALLEGRO_MAG_LINEAR);
 
-	data->timeline = TM_Init(game, data, "main");
-	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	data->checkerboard = al_create_bitmap(320, 180);
+	data->timeline = CreateFixedTimeline(game, data, "dosowisko", TIMELINE_CAPACITY);
+	CreateRenderTarget(game, "dosowisko", "text layer", &data->bitmap, 320, 180, DrawTextLayer, data);
+	data->drawn[0] = 0;
 	(*progress)(game);
 
-	data->font = al_load_ttf_font(GetDataFilePath(game, "fonts/DejaVuSansMono.ttf"),
+	data->shader = LoadShader(game, GetDataFilePath(game, "shaders/vertex.glsl"), GetDataFilePath(game, "shaders/dosowisko.glsl"));
+	(*progress)(game);
+
+	data->font = LoadFontAsset(game, "dosowisko", "fonts/DejaVuSansMono.ttf",
 		(int)(180 * 0.1666 / 8) * 8, 0);
 	(*progress)(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "dosowisko.flac"));
+	data->sample = LoadSampleAsset(game, "dosowisko", "dosowisko.flac");
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.music);
 	al_set_sample_instance_playmode(data->sound, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->kbd_sample = al_load_sample(GetDataFilePath(game, "kbd.flac"));
-	data->kbd = al_create_sample_instance(data->kbd_sample);
-	al_attach_sample_instance_to_mixer(data->kbd, game->audio.fx);
-	al_set_sample_instance_playmode(data->kbd, ALLEGRO_PLAYMODE_ONCE);
+	data->kbd_sample = LoadSampleAsset(game, "dosowisko", "kbd.flac");
+	data->kbd = SOUND_NONE;
 	(*progress)(game);
 
-	data->key_sample = al_load_sample(GetDataFilePath(game, "key.flac"));
-	data->key = al_create_sample_instance(data->key_sample);
-	al_attach_sample_instance_to_mixer(data->key, game->audio.fx);
-	al_set_sample_instance_playmode(data->key, ALLEGRO_PLAYMODE_ONCE);
+	data->key_sample = LoadSampleAsset(game, "dosowisko", "key.flac");
+	data->key = SOUND_NONE;
 	(*progress)(game);
 
 	al_set_new_bitmap_flags(flags);
@@ -200,47 +243,25 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	return data;
 }
 
-void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
-	al_set_target_bitmap(data->checkerboard);
-	al_lock_bitmap(data->checkerboard, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
-	int x, y;
-	for (x = 0; x < al_get_bitmap_width(data->checkerboard); x = x + 2) {
-		for (y = 0; y < al_get_bitmap_height(data->checkerboard); y = y + 2) {
-			al_put_pixel(x, y, al_map_rgba(0, 0, 0, 64));
-			al_put_pixel(x + 1, y, al_map_rgba(0, 0, 0, 0));
-			al_put_pixel(x, y + 1, al_map_rgba(0, 0, 0, 0));
-			al_put_pixel(x + 1, y + 1, al_map_rgba(0, 0, 0, 0));
-		}
-	}
-	al_unlock_bitmap(data->checkerboard);
-	al_set_target_backbuffer(game->display);
-}
-
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
+	LeaveAllocationGamestate("dosowisko");
 	al_stop_sample_instance(data->sound);
-	al_stop_sample_instance(data->kbd);
-	al_stop_sample_instance(data->key);
+	StopSoundEffect(game->data->sounds, data->kbd);
+	StopSoundEffect(game->data->sounds, data->key);
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
-	al_destroy_font(data->font);
+	DestroyFontAsset(game, data->font);
 	al_destroy_sample_instance(data->sound);
-	al_destroy_sample(data->sample);
-	al_destroy_sample_instance(data->kbd);
-	al_destroy_sample(data->kbd_sample);
-	al_destroy_sample_instance(data->key);
-	al_destroy_sample(data->key_sample);
-	al_destroy_bitmap(data->bitmap);
-	al_destroy_bitmap(data->checkerboard);
-	al_destroy_bitmap(data->pixelator);
-	TM_Destroy(data->timeline);
+	DestroySampleAsset(game, data->sample);
+	DestroySampleAsset(game, data->kbd_sample);
+	DestroySampleAsset(game, data->key_sample);
+	DestroyBitmapAsset(game, data->bitmap);
+	ReleaseShader(game, data->shader);
+	DestroyFixedTimeline(data->timeline);
 	free(data);
 }
 
 void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	int flags = al_get_new_bitmap_flags();
-	al_set_new_bitmap_flags(flags & ~ALLEGRO_MAG_LINEAR);
-	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	al_set_new_bitmap_flags(flags);
+	// The text layer gets recreated and redrawn along with every other asset before the next frame.
 }
@@ -22,197 +22,308 @@
 #include <libsuperderpy.h>
 
 #define NUM_STARS 42
-#define MAX_DRONES 42
+#define IDLE_RATE 20 // for screens where only the stars twinkle and the prompt blinks
+#define DRONE_SOUND_RANGE 0.6 // distance from Santa at which drones can't be heard anymore
+#define SYNTH_FREQUENCY 22050
+#define BENCHMARK_SEED 0x5eed
+#define BENCHMARK_TIME 10.5
 
-int Gamestate_ProgressCount = 11; // number of loading steps as reported by Gamestate_Load; 0 when missing
+int Gamestate_ProgressCount = 10; // number of loading steps as reported by Gamestate_Load; 0 when missing
 
 struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
-	ALLEGRO_BITMAP *star, *houses, *drone, *logo;
-	ALLEGRO_FONT *font, *bigfont;
-	ALLEGRO_AUDIO_STREAM* music;
-	ALLEGRO_SAMPLE *sample, *sample2;
-	ALLEGRO_SAMPLE_INSTANCE *lost, *start;
-	double pause;
+	ALLEGRO_BITMAP *star, *houses, *drone, *logo, *santa;
+	ALLEGRO_FONT* font;
+	struct LazyAsset* bigfont;
+	struct MusicStream* music;
+	ALLEGRO_SAMPLE *start, *hum, *sweep;
+	struct LazyAsset* lost; // only needed once somebody gets caught
+	SoundHandle lost_sound, start_sound;
+	struct {
+		SoundHandle hum;
+		int direction; // of the rotation, to hear when the light turns around
+	} drone_sounds[MAX_DRONES];
 	bool started;
-	int level;
-	bool retry;
 	struct Tween logopos;
-	char* msg;
+	char msg[32];
 	double msgtime;
 
 	struct {
-		double x, y, counter, speed, size, deviation;
-	} stars[NUM_STARS];
+		ALLEGRO_SHADER *circular, *particles;
+		struct LazyAsset* invert;
+	} shaders;
 
-	struct {
-		double x, y, rot, speed;
-		ALLEGRO_BITMAP* bitmap;
-	} santa;
+	struct ParticleSystem* particles;
+	struct DynamicResolution* resolution;
+	double time;
+	int sky; // reshuffles the stars
+	int benchmark_scene;
 
-	struct {
-		ALLEGRO_SHADER *invert, *circular;
-	} shaders;
+	struct Input* input;
+	struct PlayerInput keys; // local input for the current tick
 
-	struct {
-		bool accelerate, brake, left, right;
-	} keys;
+	struct World world;
+	double accumulator, delta;
+	int local_player, shown_level, shown_retries;
+	int heard_hits[MAX_PLAYERS];
 
+	struct NetplaySession* netplay;
 	struct {
-		bool enabled;
-		double x, y, counter, angle, left, deviation, speed, rotspeed, timemax, timemin, length, span;
-	} drones[MAX_DRONES];
+		// second peer running in the same process, for testing netplay on a single machine
+		struct NetplaySession* netplay;
+		struct World world;
+		struct PlayerInput input;
+	} loopback;
 };
 
-static double TriangleArea(double x1, double y1, double x2, double y2, double x3, double y3) {
-	return fabs((x1 * (y2 - y3) + x2 * (y3 - y1) + x3 * (y1 - y2)) / 2.0);
+static void GetBotInput(struct GamestateResources* data, struct PlayerInput* input) {
+	// something to play against in loopback mode
+	input->accelerate = (rand() % 8) ? INPUT_HELD_MAX : 0;
+	if (rand() % 16 == 0) {
+		input->left = (rand() % 2) ? INPUT_HELD_MAX : 0;
+		input->right = (!input->left && rand() % 2) ? INPUT_HELD_MAX : 0;
+	}
 }
 
-static bool IsInsideTriangle(double x1, double y1, double x2, double y2, double x3, double y3, double x, double y) {
-	double A = TriangleArea(x1, y1, x2, y2, x3, y3);
-	double A1 = TriangleArea(x, y, x2, y2, x3, y3);
-	double A2 = TriangleArea(x1, y1, x, y, x3, y3);
-	double A3 = TriangleArea(x1, y1, x2, y2, x, y);
-	return fabs(A - (A1 + A2 + A3)) < 0.001;
+static uint8_t QuantizeHeld(double held) {
+	// anything that was pressed at all has to make it into the tick
+	return (held > 0) ? fmax(1, lround(held * INPUT_HELD_MAX)) : 0;
 }
 
-static void GetDroneTriangle(struct Game* game, struct GamestateResources* data, int i, double* x1, double* y1, double* x2, double* y2, double* x3, double* y3) {
-	double x = data->drones[i].x;
-	double y = data->drones[i].y + cos(data->drones[i].counter * data->drones[i].speed) * data->drones[i].deviation + 0.02;
+static void SampleLocalInput(struct GamestateResources* data, double start, double end) {
+	double held[INPUT_ACTIONS];
+	SampleInput(data->input, start, end, held);
+	if (IsAllocationCheckRunning()) {
+		GetBotInput(data, &data->keys);
+		return;
+	}
+	data->keys.accelerate = QuantizeHeld(held[INPUT_ACCELERATE]);
+	data->keys.brake = QuantizeHeld(held[INPUT_BRAKE]);
+	data->keys.left = QuantizeHeld(held[INPUT_LEFT]);
+	data->keys.right = QuantizeHeld(held[INPUT_RIGHT]);
+}
 
-	*x1 = x;
-	*y1 = y;
-	*x2 = x + cos(data->drones[i].angle + data->drones[i].span) * data->drones[i].length;
-	*y2 = y + sin(data->drones[i].angle + data->drones[i].span) * data->drones[i].length * 1.777;
-	*x3 = x + cos(data->drones[i].angle - data->drones[i].span) * data->drones[i].length;
-	*y3 = y + sin(data->drones[i].angle - data->drones[i].span) * data->drones[i].length * 1.777;
+static void PollLoopback(struct GamestateResources* data) {
+	// The second peer can learn the seed from any poll, including the one inside NetplayAdvance,
+	// so its world gets set up right here, before it could be simulated.
+	bool synced = NetplayIsSynced(data->loopback.netplay);
+	NetplayPoll(data->loopback.netplay);
+	if (!synced && NetplayIsSynced(data->loopback.netplay)) {
+		InitWorld(&data->loopback.world, NetplayGetSeed(data->loopback.netplay), MAX_PLAYERS, DEFAULT_TICK_RATE);
+	}
 }
 
-static bool IsSantaInDroneTriangle(struct Game* game, struct GamestateResources* data, int i) {
-	// don't judge me
-	double x1, y1, x2, y2, x3, y3;
-	GetDroneTriangle(game, data, i, &x1, &y1, &x2, &y2, &x3, &y3);
-	/*
-	al_draw_filled_circle((data->santa.x) * game->viewport.width, (data->santa.y) * game->viewport.height, 15, al_map_rgb(255, 255, 255));
-	al_draw_filled_circle((data->santa.x + cos(data->santa.rot) * 0.14) * game->viewport.width, (data->santa.y + sin(data->santa.rot) * 0.14 * 1.7777) * game->viewport.height, 15, al_map_rgb(255, 255, 255));
-	al_draw_filled_circle((data->santa.x + cos(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02) * game->viewport.width, (data->santa.y + sin(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 * 1.7777) * game->viewport.height, 15, al_map_rgb(255, 255, 255));
-	al_draw_filled_circle((data->santa.x + cos(data->santa.rot) * 0.07) * game->viewport.width, (data->santa.y + sin(data->santa.rot) * 0.07 * 1.7777) * game->viewport.height, 15, al_map_rgb(255, 255, 255));
-	al_draw_filled_circle((data->santa.x + cos(data->santa.rot) * 0.035) * game->viewport.width, (data->santa.y + sin(data->santa.rot) * 0.035 * 1.7777) * game->viewport.height, 15, al_map_rgb(255, 255, 255));
-	al_draw_filled_circle((data->santa.x + cos(data->santa.rot) * 0.105) * game->viewport.width, (data->santa.y + sin(data->santa.rot) * 0.105 * 1.7777) * game->viewport.height, 15, al_map_rgb(255, 255, 255));
-	*/
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x, data->santa.y)) return true;
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02, data->santa.y + sin(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02)) return true;
-
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot) * 0.14, data->santa.y + sin(data->santa.rot) * 0.14 * 1.7777)) return true;
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + cos(data->santa.rot) * 0.14, data->santa.y + sin(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + sin(data->santa.rot) * 0.14 * 1.7777)) return true;
-
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot) * 0.07, data->santa.y + sin(data->santa.rot) * 0.07 * 1.7777)) return true;
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + cos(data->santa.rot) * 0.07, data->santa.y + sin(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + sin(data->santa.rot) * 0.07 * 1.7777)) return true;
-
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot) * 0.035, data->santa.y + sin(data->santa.rot) * 0.035 * 1.7777)) return true;
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + cos(data->santa.rot) * 0.035, data->santa.y + sin(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + sin(data->santa.rot) * 0.035 * 1.7777)) return true;
-
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot) * 0.105, data->santa.y + sin(data->santa.rot) * 0.105 * 1.7777)) return true;
-	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, data->santa.x + cos(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + cos(data->santa.rot) * 0.105, data->santa.y + sin(data->santa.rot - ALLEGRO_PI / 2.0) * 0.02 + sin(data->santa.rot) * 0.105 * 1.7777)) return true;
-	return false;
+static void Tick(struct Game* game, struct GamestateResources* data) {
+	if (data->netplay) {
+		NetplayAdvance(data->netplay, &data->world, &data->keys);
+		if (data->loopback.netplay) {
+			PollLoopback(data);
+			GetBotInput(data, &data->loopback.input);
+			NetplayAdvance(data->loopback.netplay, &data->loopback.world, &data->loopback.input);
+		}
+		return;
+	}
+	const void* inputs[MAX_PLAYERS] = {&data->keys};
+	SimulateWorld(&data->world, inputs, game->data->jobs);
 }
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	// Here you should do all your game logic as if <delta> seconds have passed.
-	for (int i = 0; i < NUM_STARS; i++) {
-		data->stars[i].counter += delta * data->stars[i].speed;
+static void PlayStartSound(struct Game* game, struct GamestateResources* data) {
+	StopSoundEffect(game->data->sounds, data->start_sound);
+	data->start_sound = PlaySoundEffect(game->data->sounds, data->start, SOUND_PARAMS(.gain = 1.5, .priority = SOUND_PRIORITY_UI));
+}
+
+static void UpdateFeedback(struct Game* game, struct GamestateResources* data) {
+	// Sounds and messages are derived from the world state after the fact, as the netcode may
+	// simulate (and re-simulate) many ticks at once.
+	struct World* world = &data->world;
+
+	if (world->level != data->shown_level || world->retries != data->shown_retries) {
+		if (world->level != data->shown_level) {
+			PlayStartSound(game, data);
+			SetMusicGain(data->music, 0.75);
+		}
+		data->shown_level = world->level;
+		data->shown_retries = world->retries;
+
+		data->sky++;
+		snprintf(data->msg, sizeof(data->msg), "Level %d", world->level + 1);
+		data->msgtime = 2;
 	}
 
-	if (data->msgtime) {
-		data->msgtime -= delta;
-		if (data->msgtime < 0) {
-			data->msgtime = 0;
+	for (int p = 0; p < world->players; p++) {
+		if (world->santas[p].hits > data->heard_hits[p]) {
+			if (p == data->local_player) {
+				SetMusicGain(data->music, 0);
+			}
+			StopSoundEffect(game->data->sounds, data->lost_sound);
+			data->lost_sound = PlaySoundEffect(game->data->sounds, GetLazySample(data->lost), SOUND_PARAMS(.priority = SOUND_PRIORITY_UI));
 		}
+		data->heard_hits[p] = world->santas[p].hits;
 	}
+}
 
-	if (!data->started) {
-		return;
+static void StartMatch(struct Game* game, struct GamestateResources* data) {
+	// both netplay peers have to agree on the tick rate, so it's only configurable for local play
+	int tick_rate = data->netplay ? DEFAULT_TICK_RATE : strtol(GetConfigOptionDefault(game, "Game", "tick_rate", "60"), NULL, 10);
+	tick_rate = fmax(10, fmin(tick_rate, 240));
+	InitWorld(&data->world, data->netplay ? NetplayGetSeed(data->netplay) : (uint32_t)rand(), data->netplay ? MAX_PLAYERS : 1, tick_rate);
+	data->local_player = data->netplay ? NetplayGetLocalPlayer(data->netplay) : 0;
+	data->shown_level = data->world.level;
+	data->shown_retries = data->world.retries;
+	data->accumulator = 0;
+	ResetInput(data->input);
+	for (int p = 0; p < MAX_PLAYERS; p++) {
+		data->heard_hits[p] = 0;
 	}
+}
 
-	UpdateTween(&data->logopos, delta);
+static void UpdateDroneSounds(struct Game* game, struct GamestateResources* data) {
+	// Every drone hums and makes a sweep sound when its light turns around. Most of them are too far
+	// away to be heard at any given time, so the voice pool keeps them virtual.
+	struct World* world = &data->world;
+	const struct Santa* santa = &world->santas[data->local_player];
+	SetSoundListener(game->data->sounds, santa->x, santa->y, DRONE_SOUND_RANGE);
 
-	if (data->pause) {
-		data->pause -= delta;
-		if (data->pause <= 0) {
-			data->retry = true;
-			Gamestate_Start(game, data);
+	for (int i = 0; i < MAX_DRONES; i++) {
+		const struct Drone* drone = &world->drones[i];
+		if (i >= world->drone_count || !drone->enabled) {
+			if (data->drone_sounds[i].hum) {
+				StopSoundEffect(game->data->sounds, data->drone_sounds[i].hum);
+				data->drone_sounds[i].hum = SOUND_NONE;
+			}
+			data->drone_sounds[i].direction = 0;
+			continue;
 		}
-		return;
+
+		double y = drone->y + cos(drone->counter * drone->speed) * drone->deviation;
+		if (IsSoundEffectPlaying(game->data->sounds, data->drone_sounds[i].hum)) {
+			MoveSoundEffect(game->data->sounds, data->drone_sounds[i].hum, drone->x, y);
+		} else {
+			data->drone_sounds[i].hum = PlaySoundEffect(game->data->sounds, data->hum,
+				SOUND_PARAMS(.gain = 0.25, .speed = 0.8 + drone->speed * 0.1, .priority = SOUND_PRIORITY_AMBIENT, .loop = true, .positional = true, .x = drone->x, .y = y));
+		}
+
+		int direction = (drone->left > 0) ? 1 : -1;
+		if (data->drone_sounds[i].direction && direction != data->drone_sounds[i].direction) {
+			PlaySoundEffect(game->data->sounds, data->sweep,
+				SOUND_PARAMS(.gain = 0.5, .speed = 0.8 + drone->rotspeed, .positional = true, .x = drone->x, .y = y));
+		}
+		data->drone_sounds[i].direction = direction;
 	}
+}
 
-	al_set_audio_stream_gain(data->music, fmin(1.0, al_get_audio_stream_gain(data->music) + delta / 2.0));
+static void StopGameSounds(struct Game* game, struct GamestateResources* data) {
+	if (PeekLazyAsset(data->lost)) {
+		StopSampleEffects(game->data->sounds, PeekLazyAsset(data->lost));
+	}
+	StopSampleEffects(game->data->sounds, data->start);
+	StopSampleEffects(game->data->sounds, data->hum);
+	StopSampleEffects(game->data->sounds, data->sweep);
+	memset(data->drone_sounds, 0, sizeof(data->drone_sounds));
+}
 
-	double dspeed = 0;
-	if (data->keys.accelerate) {
-		dspeed += 0.03;
+static void ShowBenchmarkScene(struct Game* game, struct GamestateResources* data, int scene) {
+	// Scenes are frozen, so every run draws exactly the same frames.
+	data->time = BENCHMARK_TIME;
+	if (scene == data->benchmark_scene) {
+		return;
 	}
-	if (data->keys.brake) {
-		dspeed += (data->santa.speed > 0) ? -0.02 : -0.01;
+	data->benchmark_scene = scene;
+	InitWorld(&data->world, BENCHMARK_SEED, 1, DEFAULT_TICK_RATE);
+	data->local_player = 0;
+	data->sky = 0;
+	data->started = scene != BENCHMARK_TITLE;
+	if (data->started) {
+		data->world.level = (scene == BENCHMARK_GENERATED) ? BENCHMARK_GENERATED_LEVEL : (scene - BENCHMARK_LEVEL0);
+		StartLevel(&data->world, false);
+		UpdateTween(&data->logopos, 10); // the logo is gone by the time anyone plays
+		snprintf(data->msg, sizeof(data->msg), "Level %d", data->world.level + 1);
+		data->msgtime = 1;
 	}
-	data->santa.speed = fmin(1, fmax(-0.5, data->santa.speed + dspeed));
+}
 
-	data->santa.speed *= 0.975;
+static void StartPlaying(struct Game* game, struct GamestateResources* data) {
+	PrefetchAsset(data->lost);
+	PlayStartSound(game, data);
+	SetMusicGain(data->music, 0.75);
+	data->started = true;
+}
 
-	data->santa.x += cos(data->santa.rot) * data->santa.speed * 0.005;
-	data->santa.y += sin(data->santa.rot) * data->santa.speed * 0.005;
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	// Here you should do all your game logic as if <delta> seconds have passed.
+	data->delta = delta;
+	data->time += delta;
 
-	double dangle = 0;
-	if (data->keys.left) {
-		dangle += -0.025;
+	int scene = GetRenderBenchmarkScene();
+	if (scene >= 0) {
+		ShowBenchmarkScene(game, data, scene);
+		return;
 	}
-	if (data->keys.right) {
-		dangle += 0.025;
+
+	if (data->msgtime) {
+		data->msgtime -= delta;
+		if (data->msgtime < 0) {
+			data->msgtime = 0;
+		}
 	}
-	data->santa.rot += dangle;
-	if (data->santa.rot > ALLEGRO_PI * 2) {
-		data->santa.rot -= ALLEGRO_PI * 2;
+
+	if (data->loopback.netplay && !data->started) {
+		PollLoopback(data); // keeps greeting the main session until the match starts
 	}
-	if (data->santa.rot < 0) {
-		data->santa.rot += ALLEGRO_PI * 2;
+	if (data->netplay && !data->started) {
+		NetplayPoll(data->netplay);
+		if (NetplayIsSynced(data->netplay)) {
+			StartMatch(game, data);
+			StartPlaying(game, data);
+		}
 	}
 
-	data->santa.x = fmax(0, fmin(data->santa.x, 1));
-	data->santa.y = fmax(0, fmin(data->santa.y, 1));
+	if (!data->started && !data->netplay && IsAllocationCheckRunning()) {
+		StartPlaying(game, data);
+	}
+	SetAllocationSteadyState(data->started);
 
-	for (int i = 0; i < MAX_DRONES; i++) {
-		if (!data->drones[i].enabled) continue;
-
-		data->drones[i].counter += delta;
-		if (data->drones[i].left > 0) {
-			data->drones[i].left -= delta;
-			data->drones[i].angle -= delta * data->drones[i].rotspeed;
-			if (data->drones[i].left <= 0) {
-				data->drones[i].left = (rand() / (double)RAND_MAX * (data->drones[i].timemax - data->drones[i].timemin) + data->drones[i].timemin) * ((rand() % 2) ? 1 : -1);
-			}
-		} else if (data->drones[i].left < 0) {
-			data->drones[i].left += delta;
-			data->drones[i].angle += delta * data->drones[i].rotspeed;
-			if (data->drones[i].left >= 0) {
-				data->drones[i].left = (rand() / (double)RAND_MAX * (data->drones[i].timemax - data->drones[i].timemin) + data->drones[i].timemin) * ((rand() % 2) ? 1 : -1);
-			}
+	if (!data->started) {
+		if (!data->particles || !IsParticleSystemMoving(data->particles)) {
+			RequestIdle(game, IDLE_RATE);
 		}
+		return;
+	}
 
-		if (IsSantaInDroneTriangle(game, data, i)) {
-			data->pause = 2.4;
-			al_set_audio_stream_gain(data->music, 0);
-			al_stop_sample_instance(data->lost);
-			al_play_sample_instance(data->lost);
-			return;
-		}
+	UpdateTween(&data->logopos, delta);
+
+	// Each tick covers a slice of wall clock time ending <accumulator> seconds ago, which is
+	// matched against the event timestamps when sampling the input.
+	ALLEGRO_EVENT ev;
+	while (PollLateEvent(game, &ev)) {
+		InputHandleLateEvent(data->input, &ev);
+	}
+
+	double now = al_get_time();
+	data->accumulator = fmin(data->accumulator + delta, 0.25);
+	while (data->accumulator >= data->world.delta) {
+		double start = now - data->accumulator;
+		data->accumulator -= data->world.delta;
+		SampleLocalInput(data, start, start + data->world.delta);
+		Tick(game, data);
+	}
+
+	UpdateFeedback(game, data);
+	UpdateDroneSounds(game, data);
+
+	if (data->particles) {
+		const struct Santa* santa = &data->world.santas[data->local_player];
+		UpdateParticleTrail(data->particles, data->time, santa->x, santa->y, !data->world.pause && !santa->pause);
+	}
+
+	if (data->world.pause && (!data->particles || !IsParticleSystemMoving(data->particles))) {
+		// everyone got caught and the screen is frozen until the level restarts
+		RequestIdle(game, IDLE_RATE);
 	}
 
-	if (data->santa.x > 0.99 && data->santa.y < 0.2) {
-		data->level++;
-		al_stop_sample_instance(data->start);
-		al_play_sample_instance(data->start);
-		al_set_audio_stream_gain(data->music, 0.75);
-		Gamestate_Start(game, data);
+	if (!data->world.pause && !data->world.santas[data->local_player].pause) {
+		SetMusicGain(data->music, fmin(1.0, GetMusicGain(data->music) + delta / 2.0));
 	}
 }
 
@@ -247,6 +358,8 @@ static void DrawTexturedRectangle(float x1, float y1, float x2, float y2, ALLEGR
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Draw everything to the screen here.
+	BeginBenchmarkDraw(game);
+	BeginScaledDraw(data->resolution);
 	DrawVerticalGradientRect(0, 0, game->viewport.width, game->viewport.height,
 		al_map_rgb(0, 0, 16 + 0), al_map_rgb(0, 0, 64 + 0));
 
@@ -255,11 +368,8 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	al_translate_transform(&transform, 0, GetTweenValue(&data->logopos) * game->viewport.height * 0.05);
 	PushTransform(game, &transform);
 
-	for (int i = 0; i < NUM_STARS; i++) {
-		double shininess = (1 - (cos(data->stars[i].counter * 4.2) + 1) * 0.1) * 0.8;
-		al_draw_tinted_scaled_rotated_bitmap(data->star, al_map_rgb_f(shininess, shininess, shininess), al_get_bitmap_width(data->star) / 2, al_get_bitmap_height(data->star) / 2,
-			data->stars[i].x * game->viewport.width, data->stars[i].y * game->viewport.height, data->stars[i].size * 0.8, data->stars[i].size * 0.8,
-			sin(data->stars[i].counter) * data->stars[i].deviation, 0);
+	if (data->particles) {
+		DrawParticles(data->particles, PARTICLES_STARS, data->star, data->time, data->sky);
 	}
 
 	PopTransform(game);
@@ -269,45 +379,64 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 
 	al_draw_scaled_rotated_bitmap(data->logo, al_get_bitmap_width(data->logo) / 2, al_get_bitmap_height(data->logo) / 2,
 		game->viewport.width * 0.5, game->viewport.height * -0.55, 2.5, 2.5, 0, 0);
-	if (fmod(game->time, 1.0) < 0.8 && !data->started) {
-		al_draw_text(data->font, al_map_rgb(255, 255, 255), game->viewport.width * 0.5, game->viewport.height * -0.3, ALLEGRO_ALIGN_CENTER, "Press any key...");
+	if (fmod(data->time, 1.0) < 0.8 && !data->started) {
+		al_draw_text(data->font, al_map_rgb(255, 255, 255), game->viewport.width * 0.5, game->viewport.height * -0.3, ALLEGRO_ALIGN_CENTER,
+			data->netplay ? "Waiting for the other Santa..." : "Press any key...");
 	}
 
-	al_draw_bitmap(data->houses, 0, 1221, data->level % 2 ? ALLEGRO_FLIP_HORIZONTAL : 0);
+	al_draw_bitmap(data->houses, 0, 1221, data->world.level % 2 ? ALLEGRO_FLIP_HORIZONTAL : 0);
 
 	al_use_shader(data->shaders.circular);
 	DrawTexturedRectangle(game->viewport.width * 0.96, 0, game->viewport.width * 1.06, game->viewport.height * 0.2, al_premul_rgba(19, 209, 45, 222));
 	al_use_shader(NULL);
-	al_draw_text(data->font, al_map_rgb(19, 209, 45), game->viewport.width * (0.98 + cos(game->time * 3) * 0.003), game->viewport.height * 0.077, ALLEGRO_ALIGN_CENTER, ">");
+	al_draw_text(data->font, al_map_rgb(19, 209, 45), game->viewport.width * (0.98 + cos(data->time * 3) * 0.003), game->viewport.height * 0.077, ALLEGRO_ALIGN_CENTER, ">");
 
-	for (int i = 0; i < MAX_DRONES; i++) {
-		if (!data->drones[i].enabled) continue;
+	for (int i = 0; i < data->world.drone_count; i++) {
+		const struct Drone* drone = &data->world.drones[i];
+		if (!drone->enabled) continue;
 
-		double x = data->drones[i].x;
-		double y = data->drones[i].y + cos(data->drones[i].counter * data->drones[i].speed) * data->drones[i].deviation;
+		double x = drone->x;
+		double y = drone->y + cos(drone->counter * drone->speed) * drone->deviation;
 
 		double x1, y1, x2, y2, x3, y3;
-		GetDroneTriangle(game, data, i, &x1, &y1, &x2, &y2, &x3, &y3);
+		GetDroneTriangle(drone, &x1, &y1, &x2, &y2, &x3, &y3);
 		if (data->started) {
+			bool caught = false;
+			for (int p = 0; p < data->world.players; p++) {
+				caught |= IsSantaInDroneTriangle(drone, &data->world.santas[p]);
+			}
 			al_draw_filled_triangle(x1 * game->viewport.width, y1 * game->viewport.height,
 				x2 * game->viewport.width, y2 * game->viewport.height,
 				x3 * game->viewport.width, y3 * game->viewport.height,
-				IsSantaInDroneTriangle(game, data, i) ? al_premul_rgba(255, 168, 255, 192) : al_premul_rgba(77, 168, 255, 192));
+				caught ? al_premul_rgba(255, 168, 255, 192) : al_premul_rgba(77, 168, 255, 192));
 		}
 
 		al_draw_rotated_bitmap(data->drone, al_get_bitmap_width(data->drone) / 2, al_get_bitmap_height(data->drone) / 2,
 			game->viewport.width * x, game->viewport.height * y, 0, 0);
 	}
 
-	al_draw_rotated_bitmap(data->santa.bitmap, 115, 160,
-		data->santa.x * game->viewport.width, data->santa.y * game->viewport.height,
-		data->santa.rot, (fabs(fmod(data->santa.rot + ALLEGRO_PI / 2, ALLEGRO_PI * 2)) > ALLEGRO_PI) ? ALLEGRO_FLIP_VERTICAL : 0);
+	if (data->particles && data->started) {
+		DrawParticles(data->particles, PARTICLES_TRAIL, NULL, data->time, data->sky);
+	}
+
+	for (int p = 0; p < data->world.players; p++) {
+		const struct Santa* santa = &data->world.santas[p];
+		al_draw_tinted_rotated_bitmap(data->santa, (p == data->local_player) ? al_map_rgb(255, 255, 255) : al_map_rgba(160, 160, 255, 255), 115, 160,
+			santa->x * game->viewport.width, santa->y * game->viewport.height,
+			santa->rot, (fabs(fmod(santa->rot + ALLEGRO_PI / 2, ALLEGRO_PI * 2)) > ALLEGRO_PI) ? ALLEGRO_FLIP_VERTICAL : 0);
+	}
+
+	if (data->particles) {
+		DrawParticles(data->particles, PARTICLES_SNOW, NULL, data->time, data->sky);
+	}
 
 	PopTransform(game);
+	EndScaledDraw(data->resolution); // the HUD stays at the native resolution
 
 	if (data->msgtime) {
 		al_draw_text(data->font, al_map_rgb(255, 255, 255), game->viewport.width * 0.5, game->viewport.height * 0.05, ALLEGRO_ALIGN_CENTER, data->msg);
 	}
+	EndBenchmarkDraw(game);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
@@ -317,62 +446,38 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 		UnloadCurrentGamestate(game); // mark this gamestate to be stopped and unloaded
 		// When there are no active gamestates, the engine will quit.
 	}
-	if (ev->type == ALLEGRO_EVENT_KEY_DOWN) {
-		if (!data->started) {
-			al_play_sample_instance(data->start);
-			al_set_audio_stream_gain(data->music, 0.75);
-			data->started = true;
+	if (ev->type == ALLEGRO_EVENT_KEY_DOWN || ev->type == ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN) {
+		if (!data->started && !data->netplay) {
+			StartPlaying(game, data);
 		}
 	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_UP)) {
-		data->keys.accelerate = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_UP)) {
-		data->keys.accelerate = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_DOWN)) {
-		data->keys.brake = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_DOWN)) {
-		data->keys.brake = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_LEFT)) {
-		data->keys.left = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_LEFT)) {
-		data->keys.left = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_RIGHT)) {
-		data->keys.right = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_RIGHT)) {
-		data->keys.right = false;
-	}
+	InputHandleEvent(data->input, ev);
+}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_W)) {
-		data->keys.accelerate = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_W)) {
-		data->keys.accelerate = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_S)) {
-		data->keys.brake = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_S)) {
-		data->keys.brake = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_A)) {
-		data->keys.left = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_A)) {
-		data->keys.left = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_D)) {
-		data->keys.right = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_D)) {
-		data->keys.right = false;
-	}
+static ALLEGRO_SAMPLE* CreateHumSample(void) {
+	// A second of low buzz. Every component completes a whole number of periods, so it loops seamlessly.
+	int length = SYNTH_FREQUENCY;
+	int16_t* buffer = al_malloc(length * sizeof(int16_t));
+	for (int i = 0; i < length; i++) {
+		double t = i / (double)SYNTH_FREQUENCY;
+		double value = sin(2 * ALLEGRO_PI * 110 * t) * 0.5 + sin(2 * ALLEGRO_PI * 220 * t) * 0.25 + sin(2 * ALLEGRO_PI * 330 * t) * 0.125;
+		value *= 0.8 + 0.2 * sin(2 * ALLEGRO_PI * 6 * t);
+		buffer[i] = value * 0.5 * INT16_MAX;
+	}
+	return al_create_sample(buffer, length, SYNTH_FREQUENCY, ALLEGRO_AUDIO_DEPTH_INT16, ALLEGRO_CHANNEL_CONF_1, true);
+}
+
+static ALLEGRO_SAMPLE* CreateSweepSample(void) {
+	// A short rising chirp.
+	int length = SYNTH_FREQUENCY * 0.3;
+	int16_t* buffer = al_malloc(length * sizeof(int16_t));
+	double phase = 0;
+	for (int i = 0; i < length; i++) {
+		double t = i / (double)length;
+		phase += 2 * ALLEGRO_PI * (300 + 600 * t * t) / SYNTH_FREQUENCY;
+		buffer[i] = sin(phase) * sin(ALLEGRO_PI * t) * 0.4 * INT16_MAX;
+	}
+	return al_create_sample(buffer, length, SYNTH_FREQUENCY, ALLEGRO_AUDIO_DEPTH_INT16, ALLEGRO_CHANNEL_CONF_1, true);
 }
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
@@ -382,285 +487,122 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Keep in mind that there's no OpenGL context available here. If you want to prerender something,
 	// create VBOs, etc. do it in Gamestate_PostLoad.
 
+	progress = TimeLoadingSteps("game", progress);
 	struct GamestateResources* data = calloc(1, sizeof(struct GamestateResources));
-	data->star = al_load_bitmap(GetDataFilePath(game, "gwiazdka.png"));
+	data->star = LoadBitmapAsset(game, "game", "gwiazdka.png");
 	progress(game); // report that we progressed with the loading, so the engine can move a progress bar
 
-	data->houses = al_load_bitmap(GetDataFilePath(game, "domki.png"));
+	data->houses = LoadBitmapAsset(game, "game", "domki.png");
 	progress(game);
 
-	data->santa.bitmap = al_load_bitmap(GetDataFilePath(game, "santa.png"));
+	data->santa = LoadBitmapAsset(game, "game", "santa.png");
 	progress(game);
 
-	data->drone = al_load_bitmap(GetDataFilePath(game, "drone.png"));
+	data->drone = LoadBitmapAsset(game, "game", "drone.png");
 	progress(game);
 
-	data->logo = al_load_bitmap(GetDataFilePath(game, "logo.png"));
+	data->logo = LoadBitmapAsset(game, "game", "logo.png");
 	progress(game);
 
-	data->font = al_load_font(GetDataFilePath(game, "fonts/ComicMono.ttf"), 92, 0);
+	data->font = LoadFontAsset(game, "game", "fonts/ComicMono.ttf", 92, 0);
 	progress(game);
 
-	data->bigfont = al_load_font(GetDataFilePath(game, "fonts/ComicMono.ttf"), 256, 0);
+	data->bigfont = LazyFont(game, "game", "fonts/ComicMono.ttf", 256, 0);
+	data->shaders.invert = LazyShader(game, "game", "shaders/vertex.glsl", "shaders/invert.glsl");
+	data->shaders.circular = LoadShader(game, GetDataFilePath(game, "shaders/vertex.glsl"), GetDataFilePath(game, "shaders/circular_gradient.glsl"));
 	progress(game);
 
-	data->shaders.invert = CreateShader(game, GetDataFilePath(game, "shaders/vertex.glsl"), GetDataFilePath(game, "shaders/invert.glsl"));
-	data->shaders.circular = CreateShader(game, GetDataFilePath(game, "shaders/vertex.glsl"), GetDataFilePath(game, "shaders/circular_gradient.glsl"));
-	// data->level = 4;
+	data->shaders.particles = LoadShader(game, GetDataFilePath(game, "shaders/particles_vertex.glsl"), GetDataFilePath(game, "shaders/particles.glsl"));
 	progress(game);
 
-	data->music = al_load_audio_stream(GetDataFilePath(game, "music2.flac"), 4, 2048);
-	al_set_audio_stream_playing(data->music, false);
-	al_set_audio_stream_playmode(data->music, ALLEGRO_PLAYMODE_LOOP);
-	al_attach_audio_stream_to_mixer(data->music, game->audio.music);
+	data->music = LoadMusicAsset(game, "game", "music2.flac", game->audio.music);
 	progress(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "lost.flac"));
-	data->lost = al_create_sample_instance(data->sample);
-	al_attach_sample_instance_to_mixer(data->lost, game->audio.fx);
-	progress(game);
-
-	data->sample2 = al_load_sample(GetDataFilePath(game, "start.flac"));
-	data->start = al_create_sample_instance(data->sample2);
-	al_attach_sample_instance_to_mixer(data->start, game->audio.fx);
-	al_set_sample_instance_gain(data->start, 1.5);
+	data->lost = LazySample(game, "game", "lost.flac");
+	data->start = LoadSampleAsset(game, "game", "start.flac");
+	data->hum = TrackSample(game, "game", "hum (synthesized)", CreateHumSample());
+	data->sweep = TrackSample(game, "game", "sweep (synthesized)", CreateSweepSample());
 	progress(game);
 
 	data->logopos = Tween(game, 1.0, 0.0, TWEEN_STYLE_CUBIC_OUT, 2.0);
+	data->benchmark_scene = -1;
+	data->resolution = CreateDynamicResolution(game);
+	data->input = CreateInput(game);
+
+	struct NetplayConfig config;
+	if (NetplayGetConfig(game, &config)) {
+		data->netplay = NetplayCreate(game, &config, sizeof(struct World), sizeof(struct PlayerInput), SimulateWorld, GetWorldSize, game->data->jobs);
+		if (data->netplay && config.loopback) {
+			struct NetplayConfig peer = config;
+			peer.player = !config.player;
+			peer.port = config.peer_port;
+			peer.peer_port = config.port;
+			data->loopback.netplay = NetplayCreate(game, &peer, sizeof(struct World), sizeof(struct PlayerInput), SimulateWorld, GetWorldSize, game->data->jobs);
+		}
+	}
 	return data;
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_bitmap(data->star);
-	al_destroy_bitmap(data->houses);
-	al_destroy_bitmap(data->santa.bitmap);
-	al_destroy_bitmap(data->drone);
-	al_destroy_bitmap(data->logo);
-	DestroyShader(game, data->shaders.invert);
-	DestroyShader(game, data->shaders.circular);
-	al_destroy_font(data->font);
-	al_destroy_font(data->bigfont);
-	if (data->msg) {
-		free(data->msg);
-	}
-	al_destroy_sample_instance(data->lost);
-	al_destroy_sample(data->sample);
-	al_destroy_sample_instance(data->start);
-	al_destroy_sample(data->sample2);
-	al_destroy_audio_stream(data->music);
+	DestroyBitmapAsset(game, data->star);
+	DestroyBitmapAsset(game, data->houses);
+	DestroyBitmapAsset(game, data->santa);
+	DestroyBitmapAsset(game, data->drone);
+	DestroyBitmapAsset(game, data->logo);
+	DestroyLazyAsset(data->shaders.invert);
+	ReleaseShader(game, data->shaders.circular);
+	if (data->particles) {
+		DestroyParticleSystem(data->particles);
+	}
+	ReleaseShader(game, data->shaders.particles);
+	DestroyFontAsset(game, data->font);
+	DestroyLazyAsset(data->bigfont);
+	DestroyLazyAsset(data->lost);
+	DestroySampleAsset(game, data->start);
+	DestroySampleAsset(game, data->hum);
+	DestroySampleAsset(game, data->sweep);
+	DestroyMusicAsset(game, data->music);
+	if (data->netplay) {
+		NetplayDestroy(data->netplay);
+	}
+	if (data->loopback.netplay) {
+		NetplayDestroy(data->loopback.netplay);
+	}
+	DestroyInput(data->input);
+	DestroyDynamicResolution(data->resolution);
 	free(data);
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
-	data->pause = 0;
-
-	for (int i = 0; i < NUM_STARS; i++) {
-		data->stars[i].x = rand() / (double)RAND_MAX;
-		data->stars[i].y = rand() / (double)RAND_MAX;
-		data->stars[i].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->stars[i].size = rand() / (double)RAND_MAX * 0.5 + 0.75;
-		data->stars[i].speed = rand() / (double)RAND_MAX * 0.1 + 1;
-		data->stars[i].deviation = rand() / (double)RAND_MAX;
-	}
-
-	data->santa.x = 0.055;
-	data->santa.y = 0.7;
-	data->santa.rot = -ALLEGRO_PI / 2.0;
-	data->santa.speed = 0;
-
-	if (data->level == 0 && !data->retry) {
-		al_set_audio_stream_playing(data->music, true);
-	}
-
-	if ((data->level == 0 && data->retry) || (data->level > 0)) {
-		if (data->msg) {
-			free(data->msg);
-		}
-		data->msg = strdup(PunchNumber(game, "Level XXX", 'X', data->level + 1));
-		data->msgtime = 2;
-	}
-
-	if (data->level == 0) {
-		data->drones[0].enabled = true;
-		data->drones[0].x = 0.5;
-		data->drones[0].y = 0.4;
-		data->drones[0].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[0].angle = -ALLEGRO_PI / 2;
-		data->drones[0].left = 4;
-		data->drones[0].deviation = 0.005;
-		data->drones[0].speed = 4;
-		data->drones[0].rotspeed = 0.333;
-		data->drones[0].timemin = 2;
-		data->drones[0].timemax = 5;
-		data->drones[0].span = 0.33;
-		data->drones[0].length = 0.33;
-	}
-
-	if (data->level == 1) {
-		data->drones[0].enabled = true;
-		data->drones[0].x = 0.42;
-		data->drones[0].y = 0.5;
-		data->drones[0].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[0].angle = -ALLEGRO_PI / 2 * 0.245;
-		data->drones[0].left = 3.5;
-		data->drones[0].deviation = 0.007;
-		data->drones[0].speed = 3.7;
-		data->drones[0].rotspeed = 0.4;
-		data->drones[0].timemin = 3;
-		data->drones[0].timemax = 6;
-		data->drones[0].span = 0.23;
-		data->drones[0].length = 0.33;
-
-		data->drones[1].enabled = true;
-		data->drones[1].x = 0.7;
-		data->drones[1].y = 0.3;
-		data->drones[1].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[1].angle = -ALLEGRO_PI / 2;
-		data->drones[1].left = 4;
-		data->drones[1].deviation = 0.005;
-		data->drones[1].speed = 4;
-		data->drones[1].rotspeed = 0.333;
-		data->drones[1].timemin = 2;
-		data->drones[1].timemax = 5;
-		data->drones[1].span = 0.33;
-		data->drones[1].length = 0.23;
-	}
-
-	if (data->level == 2) {
-		data->drones[0].enabled = true;
-		data->drones[0].x = 0.4;
-		data->drones[0].y = 0.3;
-		data->drones[0].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[0].angle = -ALLEGRO_PI / 2 * 0.245;
-		data->drones[0].left = 3.5;
-		data->drones[0].deviation = 0.007;
-		data->drones[0].speed = 3.7;
-		data->drones[0].rotspeed = 0.4;
-		data->drones[0].timemin = 3;
-		data->drones[0].timemax = 6;
-		data->drones[0].span = 0.33;
-		data->drones[0].length = 0.33;
-
-		data->drones[1].enabled = true;
-		data->drones[1].x = 0.55;
-		data->drones[1].y = 0.6;
-		data->drones[1].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[1].angle = -ALLEGRO_PI / 2;
-		data->drones[1].left = 4;
-		data->drones[1].deviation = 0.005;
-		data->drones[1].speed = 4;
-		data->drones[1].rotspeed = 0.333;
-		data->drones[1].timemin = 2;
-		data->drones[1].timemax = 5;
-		data->drones[1].span = 0.33;
-		data->drones[1].length = 0.33;
-
-		data->drones[2].enabled = true;
-		data->drones[2].x = 0.75;
-		data->drones[2].y = 0.5;
-		data->drones[2].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[2].angle = -ALLEGRO_PI / 2 * rand();
-		data->drones[2].left = 1;
-		data->drones[2].deviation = 0.005;
-		data->drones[2].speed = 4;
-		data->drones[2].rotspeed = 0.5;
-		data->drones[2].timemin = 1;
-		data->drones[2].timemax = 3;
-		data->drones[2].span = 0.33;
-		data->drones[2].length = 0.33;
-	}
-
-	if (data->level == 3) {
-		data->drones[0].enabled = true;
-		data->drones[0].x = 0.41;
-		data->drones[0].y = 0.6;
-		data->drones[0].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[0].angle = -ALLEGRO_PI / 2 * 0.245;
-		data->drones[0].left = 3.5;
-		data->drones[0].deviation = 0.007;
-		data->drones[0].speed = 3.7;
-		data->drones[0].rotspeed = 0.4;
-		data->drones[0].timemin = 3;
-		data->drones[0].timemax = 6;
-		data->drones[0].span = 0.23;
-		data->drones[0].length = 0.23;
-
-		data->drones[1].enabled = true;
-		data->drones[1].x = 0.5;
-		data->drones[1].y = 0.3;
-		data->drones[1].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[1].angle = -ALLEGRO_PI / 2;
-		data->drones[1].left = 4;
-		data->drones[1].deviation = 0.005;
-		data->drones[1].speed = 4;
-		data->drones[1].rotspeed = 0.333;
-		data->drones[1].timemin = 2;
-		data->drones[1].timemax = 5;
-		data->drones[1].span = 0.13;
-		data->drones[1].length = 0.35;
-
-		data->drones[2].enabled = true;
-		data->drones[2].x = 0.7;
-		data->drones[2].y = 0.55;
-		data->drones[2].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[2].angle = -ALLEGRO_PI / 2 * rand();
-		data->drones[2].left = 1;
-		data->drones[2].deviation = 0.005;
-		data->drones[2].speed = 4;
-		data->drones[2].rotspeed = 0.5;
-		data->drones[2].timemin = 1;
-		data->drones[2].timemax = 3;
-		data->drones[2].span = 0.33;
-		data->drones[2].length = 0.33;
-
-		data->drones[3].enabled = true;
-		data->drones[3].x = 0.66;
-		data->drones[3].y = 0.5;
-		data->drones[3].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-		data->drones[3].angle = -ALLEGRO_PI / 2 * rand();
-		data->drones[3].left = 1;
-		data->drones[3].deviation = 0.2;
-		data->drones[3].speed = 0.5;
-		data->drones[3].rotspeed = 0.2;
-		data->drones[3].timemin = 1;
-		data->drones[3].timemax = 3;
-		data->drones[3].span = 0.45;
-		data->drones[3].length = 0.1;
-	}
-
-	if (data->level > 3 && !data->retry) {
-		for (int i = 0; i < data->level; i++) {
-			data->drones[i].enabled = true;
-			data->drones[i].x = 0.4 + rand() / (double)RAND_MAX * 0.4;
-			data->drones[i].y = 0.1 + rand() / (double)RAND_MAX * 0.8;
-			data->drones[i].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-			data->drones[i].angle = rand();
-			data->drones[i].left = rand() / (double)RAND_MAX * 5;
-			data->drones[i].deviation = rand() / (double)RAND_MAX * 0.05;
-			data->drones[i].speed = 1 + rand() / (double)RAND_MAX * 3;
-			data->drones[i].rotspeed = 0.1 + rand() / (double)RAND_MAX * 0.4;
-			data->drones[i].timemin = 1 + rand() / (double)RAND_MAX * 4;
-			data->drones[i].timemax = data->drones[i].timemin + rand() / (double)RAND_MAX * 4;
-			data->drones[i].span = 0.1 + rand() / (double)RAND_MAX * 0.23;
-			data->drones[i].length = 0.1 + rand() / (double)RAND_MAX * 0.23;
-		}
-	}
-	if (data->level > 3 && data->retry) {
-		for (int i = 0; i < data->level; i++) {
-			data->drones[i].counter = rand() / (double)RAND_MAX * ALLEGRO_PI;
-			data->drones[i].angle = rand();
-		}
-	}
-
-	data->retry = false;
+	EnterAllocationGamestate("game");
+	StartMatch(game, data);
+	data->sky = rand() % 1024;
+	SetMusicPlaying(data->music, true);
+	StartupGamestateStarted("game");
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	LeaveAllocationGamestate("game");
+	StopGameSounds(game, data);
+	struct InputStats stats = GetInputStats(data->input);
+	if (stats.presses) {
+		PrintConsole(game, "Input: %d presses, event to simulation latency %.2f ms average, %.2f ms max",
+			stats.presses, stats.average_latency * 1000.0, stats.max_latency * 1000.0);
+	}
+}
+
+static void CreateParticles(struct Game* game, struct GamestateResources* data) {
+	int counts[PARTICLES_KINDS] = {
+		[PARTICLES_STARS] = NUM_STARS,
+		[PARTICLES_SNOW] = fmax(0, strtol(GetConfigOptionDefault(game, "Graphics", "snow", "100000"), NULL, 10)),
+		[PARTICLES_TRAIL] = fmax(0, strtol(GetConfigOptionDefault(game, "Graphics", "trail", "4096"), NULL, 10)),
+	};
+	data->particles = CreateParticleSystem(game, data->shaders.particles, counts);
 }
 
 // Optional endpoints:
@@ -668,6 +610,17 @@ void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
 	// This is called in the main thread after Gamestate_Load has ended.
 	// Use it to prerender bitmaps, create VBOs, etc.
+	MarkStartupPhase("game: until post-load");
+	CreateParticles(game, data);
+
+	// Glyphs get rasterized on their first use, so render the ones used by level messages up front
+	// to keep it from happening mid-game.
+	ALLEGRO_BITMAP* scratch = al_create_bitmap(16, 16);
+	al_set_target_bitmap(scratch);
+	al_draw_text(data->font, al_map_rgb(255, 255, 255), 0, 0, ALLEGRO_ALIGN_LEFT, "Level 0123456789");
+	al_set_target_backbuffer(game->display);
+	al_destroy_bitmap(scratch);
+	MarkStartupPhase("game: post-load");
 }
 
 void Gamestate_Pause(struct Game* game, struct GamestateResources* data) {
@@ -681,5 +634,10 @@ void Gamestate_Resume(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
 	// Called when the display gets lost and not preserved bitmaps need to be recreated.
-	// Unless you want to support mobile platforms, you should be able to ignore it.
+	// Bitmaps get restored along with every other asset before the next frame, but the particles'
+	// vertex buffer is gone as well. It only holds per-particle seeds, so it's simply built again.
+	if (data->particles) {
+		DestroyParticleSystem(data->particles);
+		CreateParticles(game, data);
+	}
 }
@@ -46,5 +46,10 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	free(data);
 }
 
-void Gamestate_Start(struct Game* game, struct GamestateResources* data) {}
-void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {}
+void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
+	EnterAllocationGamestate("loading");
+}
+
+void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
+	LeaveAllocationGamestate("loading");
+}
@@ -0,0 +1,320 @@
+/*! \file input.c
+ *  \brief Rebindable, timestamped input.
+ *
+ *  Every change of an action's state is queued together with the timestamp
+ *  of the event that caused it. The simulation then asks for the fraction of
+ *  each step during which an action was held, so the exact timing of presses
+ *  is preserved and taps shorter than a step don't get lost.
+ *
+ *  Bindings are read from the [Input] config section as space separated lists:
+ *
+ *    key:NAME       keyboard key, as named by al_keycode_to_name
+ *    button:N       button N of any joystick
+ *    axis:S:A:+/-   axis A of stick S of any joystick, pushed in given direction
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input.h"
+#include <libsuperderpy.h>
+#include <strings.h>
+
+#define MAX_BINDINGS 8
+#define QUEUE_SIZE 256
+#define AXIS_THRESHOLD 0.5
+#define MIN_TAP 0.004 // shortest press that still has an effect, in seconds
+#define RECENT_EVENTS 8
+
+enum BindingType {
+	BINDING_KEY,
+	BINDING_BUTTON,
+	BINDING_AXIS
+};
+
+struct Binding {
+	enum BindingType type;
+	int code; // keycode or button
+	int stick, axis;
+	float direction;
+	bool down;
+};
+
+struct InputChange {
+	enum InputAction action;
+	bool down;
+	double timestamp;
+};
+
+struct Input {
+	struct Game* game;
+	struct {
+		struct Binding bindings[MAX_BINDINGS];
+		int count;
+		bool down; // as seen by events
+		bool sampled; // as seen by the simulation
+	} actions[INPUT_ACTIONS];
+
+	struct InputChange queue[QUEUE_SIZE];
+	int head, tail;
+
+	// the same event may come both from the engine and from PollLateEvent
+	double late_timestamp; // newest event seen through PollLateEvent
+	ALLEGRO_EVENT recent[RECENT_EVENTS];
+	int recent_pos;
+
+	int presses;
+	double total_latency, max_latency;
+};
+
+static const struct {
+	const char* name;
+	const char* defaults;
+} ActionConfig[INPUT_ACTIONS] = {
+	[INPUT_ACCELERATE] = {"accelerate", "key:UP key:W button:0 axis:0:1:-"},
+	[INPUT_BRAKE] = {"brake", "key:DOWN key:S button:1 axis:0:1:+"},
+	[INPUT_LEFT] = {"left", "key:LEFT key:A axis:0:0:-"},
+	[INPUT_RIGHT] = {"right", "key:RIGHT key:D axis:0:0:+"},
+};
+
+static int FindKeycode(const char* name) {
+	for (int i = 1; i < ALLEGRO_KEY_MAX; i++) {
+		if (strcasecmp(al_keycode_to_name(i), name) == 0) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+bool BindInput(struct Input* input, enum InputAction action, const char* spec) {
+	if (input->actions[action].count >= MAX_BINDINGS) {
+		return false;
+	}
+	struct Binding binding = {0};
+	char sign;
+	if (strncmp(spec, "key:", 4) == 0) {
+		binding.type = BINDING_KEY;
+		binding.code = FindKeycode(spec + 4);
+		if (!binding.code) {
+			return false;
+		}
+	} else if (sscanf(spec, "button:%d", &binding.code) == 1) {
+		binding.type = BINDING_BUTTON;
+	} else if (sscanf(spec, "axis:%d:%d:%c", &binding.stick, &binding.axis, &sign) == 3 && (sign == '+' || sign == '-')) {
+		binding.type = BINDING_AXIS;
+		binding.direction = (sign == '+') ? 1 : -1;
+	} else {
+		return false;
+	}
+	input->actions[action].bindings[input->actions[action].count++] = binding;
+	return true;
+}
+
+void ClearInputBindings(struct Input* input, enum InputAction action) {
+	input->actions[action].count = 0;
+	input->actions[action].down = false;
+}
+
+struct Input* CreateInput(struct Game* game) {
+	struct Input* input = calloc(1, sizeof(struct Input));
+	input->game = game;
+	for (int i = 0; i < INPUT_ACTIONS; i++) {
+		char* specs = strdup(GetConfigOptionDefault(game, "Input", (char*)ActionConfig[i].name, ActionConfig[i].defaults));
+		char* saveptr = NULL;
+		for (char* spec = strtok_r(specs, " ,", &saveptr); spec; spec = strtok_r(NULL, " ,", &saveptr)) {
+			if (!BindInput(input, i, spec)) {
+				PrintConsole(game, "Input: invalid binding \"%s\" for %s", spec, ActionConfig[i].name);
+			}
+		}
+		free(specs);
+	}
+	return input;
+}
+
+void DestroyInput(struct Input* input) {
+	free(input);
+}
+
+static void PushChange(struct Input* input, enum InputAction action, bool down, double timestamp) {
+	if ((input->head + 1) % QUEUE_SIZE == input->tail) {
+		// nobody's consuming the input right now; just drop the oldest change
+		input->actions[input->queue[input->tail].action].sampled = input->queue[input->tail].down;
+		input->tail = (input->tail + 1) % QUEUE_SIZE;
+	}
+	input->queue[input->head] = (struct InputChange){.action = action, .down = down, .timestamp = timestamp};
+	input->head = (input->head + 1) % QUEUE_SIZE;
+}
+
+static bool MatchBinding(struct Binding* binding, ALLEGRO_EVENT* ev, bool* down) {
+	switch (binding->type) {
+		case BINDING_KEY:
+			if ((ev->type == ALLEGRO_EVENT_KEY_DOWN || ev->type == ALLEGRO_EVENT_KEY_UP) && ev->keyboard.keycode == binding->code) {
+				*down = ev->type == ALLEGRO_EVENT_KEY_DOWN;
+				return true;
+			}
+			return false;
+		case BINDING_BUTTON:
+			if ((ev->type == ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN || ev->type == ALLEGRO_EVENT_JOYSTICK_BUTTON_UP) && ev->joystick.button == binding->code) {
+				*down = ev->type == ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN;
+				return true;
+			}
+			return false;
+		case BINDING_AXIS:
+			if (ev->type == ALLEGRO_EVENT_JOYSTICK_AXIS && ev->joystick.stick == binding->stick && ev->joystick.axis == binding->axis) {
+				*down = ev->joystick.pos * binding->direction > AXIS_THRESHOLD;
+				return true;
+			}
+			return false;
+	}
+	return false;
+}
+
+static bool IsSameEvent(ALLEGRO_EVENT* a, ALLEGRO_EVENT* b) {
+	if (a->type != b->type || a->any.timestamp != b->any.timestamp) {
+		return false;
+	}
+	switch (a->type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_UP:
+			return a->keyboard.keycode == b->keyboard.keycode;
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+			return a->joystick.button == b->joystick.button;
+		case ALLEGRO_EVENT_JOYSTICK_AXIS:
+			return a->joystick.stick == b->joystick.stick && a->joystick.axis == b->joystick.axis && a->joystick.pos == b->joystick.pos;
+		default:
+			return true;
+	}
+}
+
+static bool IsDuplicate(struct Input* input, ALLEGRO_EVENT* ev, bool late) {
+	// Events from different sources aren't ordered by their timestamps, so only the ones older than what
+	// PollLateEvent has already gone through can be assumed to have been handled. Anything else has to be
+	// an exact match.
+	if (!late && ev->any.timestamp < input->late_timestamp) {
+		return true;
+	}
+	for (int i = 0; i < RECENT_EVENTS; i++) {
+		if (IsSameEvent(&input->recent[i], ev)) {
+			return true;
+		}
+	}
+	if (late) {
+		input->late_timestamp = fmax(input->late_timestamp, ev->any.timestamp);
+	}
+	input->recent[input->recent_pos] = *ev;
+	input->recent_pos = (input->recent_pos + 1) % RECENT_EVENTS;
+	return false;
+}
+
+static bool HandleEvent(struct Input* input, ALLEGRO_EVENT* ev, bool late) {
+	if (ev->type != ALLEGRO_EVENT_KEY_DOWN && ev->type != ALLEGRO_EVENT_KEY_UP && ev->type != ALLEGRO_EVENT_JOYSTICK_AXIS &&
+		ev->type != ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN && ev->type != ALLEGRO_EVENT_JOYSTICK_BUTTON_UP) {
+		return false;
+	}
+	if (IsDuplicate(input, ev, late)) {
+		return false;
+	}
+	bool handled = false;
+	for (int i = 0; i < INPUT_ACTIONS; i++) {
+		bool down = false, changed = false;
+		for (int j = 0; j < input->actions[i].count; j++) {
+			struct Binding* binding = &input->actions[i].bindings[j];
+			bool pressed;
+			if (MatchBinding(binding, ev, &pressed)) {
+				handled = true;
+				changed = true;
+				binding->down = pressed;
+			}
+			down |= binding->down;
+		}
+		if (changed && down != input->actions[i].down) {
+			input->actions[i].down = down;
+			PushChange(input, i, down, ev->any.timestamp);
+		}
+	}
+	return handled;
+}
+
+bool InputHandleEvent(struct Input* input, ALLEGRO_EVENT* ev) {
+	// For events delivered by the engine. Returns true when the event was bound to some action.
+	return HandleEvent(input, ev, false);
+}
+
+bool InputHandleLateEvent(struct Input* input, ALLEGRO_EVENT* ev) {
+	// For events returned by PollLateEvent.
+	return HandleEvent(input, ev, true);
+}
+
+void SampleInput(struct Input* input, double start, double end, double held[INPUT_ACTIONS]) {
+	// Fills <held> with the fraction of the [start, end) step during which each action was held.
+	double now = al_get_time();
+	double time[INPUT_ACTIONS], last[INPUT_ACTIONS];
+	bool pressed[INPUT_ACTIONS] = {false};
+	for (int i = 0; i < INPUT_ACTIONS; i++) {
+		time[i] = 0;
+		last[i] = start;
+	}
+
+	while (input->tail != input->head && input->queue[input->tail].timestamp < end) {
+		struct InputChange* change = &input->queue[input->tail];
+		input->tail = (input->tail + 1) % QUEUE_SIZE;
+
+		double timestamp = fmax(change->timestamp, start);
+		if (input->actions[change->action].sampled) {
+			time[change->action] += timestamp - last[change->action];
+		}
+		last[change->action] = timestamp;
+		input->actions[change->action].sampled = change->down;
+
+		if (change->down) {
+			pressed[change->action] = true;
+			double latency = now - change->timestamp;
+			input->presses++;
+			input->total_latency += latency;
+			input->max_latency = fmax(input->max_latency, latency);
+		}
+	}
+
+	for (int i = 0; i < INPUT_ACTIONS; i++) {
+		if (input->actions[i].sampled) {
+			time[i] += end - last[i];
+		}
+		if (pressed[i]) {
+			time[i] = fmax(time[i], MIN_TAP);
+		}
+		held[i] = fmin(1.0, time[i] / (end - start));
+	}
+}
+
+void ResetInput(struct Input* input) {
+	// Forgets the queued changes, keeping whatever is held right now.
+	input->tail = input->head;
+	for (int i = 0; i < INPUT_ACTIONS; i++) {
+		input->actions[i].sampled = input->actions[i].down;
+	}
+	input->presses = 0;
+	input->total_latency = 0;
+	input->max_latency = 0;
+}
+
+struct InputStats GetInputStats(struct Input* input) {
+	return (struct InputStats){
+		.presses = input->presses,
+		.average_latency = input->presses ? (input->total_latency / input->presses) : 0,
+		.max_latency = input->max_latency,
+	};
+}
@@ -0,0 +1,51 @@
+/*! \file input.h
+ *  \brief Rebindable, timestamped input.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_INPUT_H
+#define SECRETSANTA_INPUT_H
+
+#include <libsuperderpy.h>
+
+enum InputAction {
+	INPUT_ACCELERATE,
+	INPUT_BRAKE,
+	INPUT_LEFT,
+	INPUT_RIGHT,
+	INPUT_ACTIONS
+};
+
+struct InputStats {
+	int presses;
+	double average_latency, max_latency; // from the event timestamp to the simulation step consuming it
+};
+
+struct Input;
+
+struct Input* CreateInput(struct Game* game);
+void DestroyInput(struct Input* input);
+bool BindInput(struct Input* input, enum InputAction action, const char* spec);
+void ClearInputBindings(struct Input* input, enum InputAction action);
+bool InputHandleEvent(struct Input* input, ALLEGRO_EVENT* ev);
+bool InputHandleLateEvent(struct Input* input, ALLEGRO_EVENT* ev);
+void SampleInput(struct Input* input, double start, double end, double held[INPUT_ACTIONS]);
+void ResetInput(struct Input* input);
+struct InputStats GetInputStats(struct Input* input);
+
+#endif
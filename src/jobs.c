@@ -0,0 +1,279 @@
+/*! \file jobs.c
+ *  \brief Work-stealing job system.
+ *
+ *  Every worker (including the main thread, which always participates) owns a
+ *  deque of index ranges. Ranges bigger than the grain size get split in half,
+ *  with one half pushed to the bottom of the owner's deque; idle workers steal
+ *  from the top of other deques, so they pick up the biggest pieces first.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jobs.h"
+#include <libsuperderpy.h>
+#include <stdatomic.h>
+
+#define DEQUE_SIZE 256
+
+struct Task {
+	JobRangeFunc* func;
+	void* userdata;
+	int start, end, grain;
+};
+
+struct Worker {
+	struct JobSystem* jobs;
+	int index;
+	uint32_t rng;
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_MUTEX* mutex;
+	struct Task tasks[DEQUE_SIZE];
+	int top, bottom; // thieves take from the top, the owner pushes and pops at the bottom
+};
+
+struct JobSystem {
+	int count;
+	struct Worker workers[JOBS_MAX_THREADS];
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+	atomic_int pending; // items left to process in the current ParallelFor
+	atomic_bool active;
+	bool stop;
+};
+
+static bool PushTask(struct Worker* worker, const struct Task* task) {
+	bool pushed = false;
+	al_lock_mutex(worker->mutex);
+	if (worker->bottom - worker->top < DEQUE_SIZE) {
+		worker->tasks[worker->bottom % DEQUE_SIZE] = *task;
+		worker->bottom++;
+		pushed = true;
+	}
+	al_unlock_mutex(worker->mutex);
+	return pushed;
+}
+
+static bool PopTask(struct Worker* worker, struct Task* task) {
+	bool popped = false;
+	al_lock_mutex(worker->mutex);
+	if (worker->bottom > worker->top) {
+		worker->bottom--;
+		*task = worker->tasks[worker->bottom % DEQUE_SIZE];
+		popped = true;
+	}
+	if (worker->bottom == worker->top) {
+		worker->bottom = worker->top = 0;
+	}
+	al_unlock_mutex(worker->mutex);
+	return popped;
+}
+
+static bool StealTask(struct Worker* victim, struct Task* task) {
+	bool stolen = false;
+	al_lock_mutex(victim->mutex);
+	if (victim->bottom > victim->top) {
+		*task = victim->tasks[victim->top % DEQUE_SIZE];
+		victim->top++;
+		stolen = true;
+	}
+	al_unlock_mutex(victim->mutex);
+	return stolen;
+}
+
+static bool FindTask(struct Worker* worker, struct Task* task) {
+	if (PopTask(worker, task)) {
+		return true;
+	}
+	struct JobSystem* jobs = worker->jobs;
+	worker->rng = worker->rng * 1664525u + 1013904223u;
+	int offset = (worker->rng >> 16) % jobs->count;
+	for (int i = 0; i < jobs->count; i++) {
+		struct Worker* victim = &jobs->workers[(offset + i) % jobs->count];
+		if (victim != worker && StealTask(victim, task)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void RunTask(struct Worker* worker, struct Task* task) {
+	while (task->end - task->start > task->grain) {
+		struct Task half = *task;
+		half.start = task->start + (task->end - task->start) / 2;
+		if (!PushTask(worker, &half)) {
+			break;
+		}
+		task->end = half.start;
+	}
+	task->func(task->start, task->end, task->userdata);
+	atomic_fetch_sub(&worker->jobs->pending, task->end - task->start);
+}
+
+static void* WorkerThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct Worker* worker = arg;
+	struct JobSystem* jobs = worker->jobs;
+	while (true) {
+		struct Task task;
+		if (FindTask(worker, &task)) {
+			RunTask(worker, &task);
+			continue;
+		}
+		if (atomic_load(&jobs->active)) {
+			al_rest(0);
+			continue;
+		}
+
+		al_lock_mutex(jobs->mutex);
+		while (!jobs->stop && !atomic_load(&jobs->active)) {
+			al_wait_cond(jobs->cond, jobs->mutex);
+		}
+		bool stop = jobs->stop;
+		al_unlock_mutex(jobs->mutex);
+		if (stop) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+struct JobSystem* CreateJobSystem(int threads) {
+	if (threads <= 0) {
+		threads = al_get_cpu_count();
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > JOBS_MAX_THREADS) {
+		threads = JOBS_MAX_THREADS;
+	}
+
+	struct JobSystem* jobs = calloc(1, sizeof(struct JobSystem));
+	jobs->count = threads;
+	jobs->mutex = al_create_mutex();
+	jobs->cond = al_create_cond();
+	atomic_init(&jobs->pending, 0);
+	atomic_init(&jobs->active, false);
+	for (int i = 0; i < threads; i++) {
+		struct Worker* worker = &jobs->workers[i];
+		worker->jobs = jobs;
+		worker->index = i;
+		worker->rng = i + 1;
+		worker->mutex = al_create_mutex();
+		// the first worker is the thread calling ParallelFor
+		if (i > 0) {
+			worker->thread = al_create_thread(WorkerThread, worker);
+			al_start_thread(worker->thread);
+		}
+	}
+	return jobs;
+}
+
+void DestroyJobSystem(struct JobSystem* jobs) {
+	al_lock_mutex(jobs->mutex);
+	jobs->stop = true;
+	al_broadcast_cond(jobs->cond);
+	al_unlock_mutex(jobs->mutex);
+	for (int i = 0; i < jobs->count; i++) {
+		if (jobs->workers[i].thread) {
+			al_join_thread(jobs->workers[i].thread, NULL);
+			al_destroy_thread(jobs->workers[i].thread);
+		}
+		al_destroy_mutex(jobs->workers[i].mutex);
+	}
+	al_destroy_cond(jobs->cond);
+	al_destroy_mutex(jobs->mutex);
+	free(jobs);
+}
+
+int GetJobSystemThreads(struct JobSystem* jobs) {
+	return jobs ? jobs->count : 1;
+}
+
+void ParallelFor(struct JobSystem* jobs, int count, int grain, JobRangeFunc* func, void* userdata) {
+	// Must be called from the thread that created the job system. Returns once all items are processed.
+	if (count <= 0) {
+		return;
+	}
+	if (grain < 1) {
+		grain = 1;
+	}
+	if (!jobs || jobs->count == 1 || count <= grain) {
+		func(0, count, userdata);
+		return;
+	}
+
+	struct Worker* worker = &jobs->workers[0];
+	atomic_store(&jobs->pending, count);
+	al_lock_mutex(jobs->mutex);
+	atomic_store(&jobs->active, true);
+	al_broadcast_cond(jobs->cond);
+	al_unlock_mutex(jobs->mutex);
+
+	struct Task task = {.func = func, .userdata = userdata, .start = 0, .end = count, .grain = grain};
+	RunTask(worker, &task);
+	while (atomic_load(&jobs->pending) > 0) {
+		if (FindTask(worker, &task)) {
+			RunTask(worker, &task);
+		}
+	}
+	atomic_store(&jobs->active, false);
+}
+
+#define BENCHMARK_ITEMS (1 << 18)
+#define BENCHMARK_ITERATIONS 50
+
+static void BenchmarkJob(int start, int end, void* userdata) {
+	double* results = userdata;
+	for (int i = start; i < end; i++) {
+		// roughly the cost of moving a drone and testing it against Santa's hitbox
+		double angle = i * 0.001;
+		double sum = 0;
+		for (int j = 0; j < 10; j++) {
+			sum += cos(angle + j) * sin(angle - j);
+		}
+		results[i] = sum;
+	}
+}
+
+int RunJobsBenchmark(void) {
+	double* results = malloc(sizeof(double) * BENCHMARK_ITEMS);
+	int max = al_get_cpu_count();
+	if (max > JOBS_MAX_THREADS) {
+		max = JOBS_MAX_THREADS;
+	}
+	double base = 0;
+
+	printf("Job system scaling, %d items, %d iterations\n", BENCHMARK_ITEMS, BENCHMARK_ITERATIONS);
+	for (int threads = 1; threads <= max; threads++) {
+		struct JobSystem* jobs = CreateJobSystem(threads);
+		ParallelFor(jobs, BENCHMARK_ITEMS, 256, BenchmarkJob, results); // warm up
+
+		double start = al_get_time();
+		for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+			ParallelFor(jobs, BENCHMARK_ITEMS, 256, BenchmarkJob, results);
+		}
+		double time = (al_get_time() - start) / BENCHMARK_ITERATIONS;
+		DestroyJobSystem(jobs);
+
+		if (threads == 1) {
+			base = time;
+		}
+		printf("%2d threads: %8.3f ms  speedup %.2fx  efficiency %3.0f%%\n", threads, time * 1000.0, base / time, base / time / threads * 100.0);
+	}
+	free(results);
+	return 0;
+}
@@ -0,0 +1,39 @@
+/*! \file jobs.h
+ *  \brief Work-stealing job system.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_JOBS_H
+#define SECRETSANTA_JOBS_H
+
+#include <libsuperderpy.h>
+
+#define JOBS_MAX_THREADS 16
+
+/*! \brief Processes items from <start> up to (but not including) <end>. */
+typedef void JobRangeFunc(int start, int end, void* userdata);
+
+struct JobSystem;
+
+struct JobSystem* CreateJobSystem(int threads);
+void DestroyJobSystem(struct JobSystem* jobs);
+int GetJobSystemThreads(struct JobSystem* jobs);
+void ParallelFor(struct JobSystem* jobs, int count, int grain, JobRangeFunc* func, void* userdata);
+int RunJobsBenchmark(void);
+
+#endif
@@ -29,14 +29,99 @@ static _Noreturn void derp(int sig) {
 	abort();
 }
 
+static bool HasArgument(int argc, char** argv, const char* name) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static const char* GetArgumentValue(int argc, char** argv, const char* name) {
+	// for arguments in --name=value form
+	size_t len = strlen(name);
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+			return argv[i] + len + 1;
+		}
+	}
+	return NULL;
+}
+
 int main(int argc, char** argv) {
+	if (HasArgument(argc, argv, "--bench-startup") || GetArgumentValue(argc, argv, "--bench-startup")) {
+#ifdef STARTUP_BENCHMARK
+		const char* output = GetArgumentValue(argc, argv, "--bench-startup");
+		InitStartupBenchmark(output ? output : "startup.json");
+#else
+		fprintf(stderr, "--bench-startup requires a build with -DSTARTUP_BENCHMARK=ON\n");
+		return 1;
+#endif
+	}
+
 	signal(SIGSEGV, derp);
 
+	if (HasArgument(argc, argv, "--bench-jobs")) {
+		al_init();
+		return RunJobsBenchmark();
+	}
+
+	if (HasArgument(argc, argv, "--bench-netplay")) {
+		al_init();
+		return RunRollbackBenchmark();
+	}
+
 	srand(time(NULL));
 
 	al_set_org_name("dosowisko.net");
 	al_set_app_name(LIBSUPERDERPY_GAMENAME_PRETTY);
 
+	al_init();
+	MarkStartupPhase("al_init");
+	if (IsStartupBenchmarkEnabled()) {
+		// don't let waiting for the display skew the first frame
+		al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST);
+	}
+
+	double alloc_check = 0;
+	if (HasArgument(argc, argv, "--alloc-check") || GetArgumentValue(argc, argv, "--alloc-check")) {
+#ifdef ALLOC_TRACKING
+		const char* duration = GetArgumentValue(argc, argv, "--alloc-check");
+		alloc_check = duration ? strtod(duration, NULL) : 20.0;
+#else
+		fprintf(stderr, "--alloc-check requires a build with -DALLOC_TRACKING=ON\n");
+		return 1;
+#endif
+	}
+
+	struct RenderBenchmarkConfig bench = {0};
+	if (HasArgument(argc, argv, "--bench-render") || GetArgumentValue(argc, argv, "--bench-render")) {
+#ifdef RENDER_BENCHMARK
+		const char* golden = GetArgumentValue(argc, argv, "--bench-render");
+		const char* threshold = GetArgumentValue(argc, argv, "--threshold");
+		const char* tolerance = GetArgumentValue(argc, argv, "--tolerance");
+		bench = (struct RenderBenchmarkConfig){
+			.golden = golden ? golden : "data/golden",
+			.update = HasArgument(argc, argv, "--update-golden"),
+			.threshold = threshold ? strtol(threshold, NULL, 10) : 8,
+			.tolerance = (tolerance ? strtod(tolerance, NULL) : 0.1) / 100.0, // in percent
+		};
+		// measure the drawing rather than waiting for the display
+		al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST);
+#else
+		fprintf(stderr, "--bench-render requires a build with -DRENDER_BENCHMARK=ON\n");
+		return 1;
+#endif
+	}
+
+	const char* vsync = GetArgumentValue(argc, argv, "--vsync");
+	if (vsync) {
+		// "adaptive" leaves presenting to the variable refresh rate display, paced by --fps
+		// only suggested, so a driver that can't do it still gets a window, just without the pacing
+		al_set_new_display_option(ALLEGRO_VSYNC, (strcmp(vsync, "on") == 0) ? 1 : 2, ALLEGRO_SUGGEST);
+	}
+
 	struct Game* game = libsuperderpy_init(argc, argv, LIBSUPERDERPY_GAMENAME,
 		(struct Params){
 			3840,
@@ -44,14 +129,47 @@ int main(int argc, char** argv) {
 			.handlers = {
 				.event = GlobalEventHandler,
 				.destroy = DestroyGameData,
+				.prelogic = PreLogic,
+				.postlogic = PostLogic,
+				.predraw = PreDraw,
+				.postdraw = PostDraw,
 			},
 		});
 	if (!game) { return 1; }
+	if (vsync) {
+		int obtained = al_get_display_option(game->display, ALLEGRO_VSYNC);
+		PrintConsole(game, "Vsync: requested %s, got %s", vsync, (obtained == 1) ? "on" : ((obtained == 2) ? "off" : "driver default"));
+	}
+	MarkStartupPhase("libsuperderpy_init");
 
-	LoadGamestate(game, "dosowisko");
-	StartGamestate(game, "dosowisko");
+	// the allocation check and the startup benchmark go straight to the game
+	const char* gamestate = (alloc_check || IsStartupBenchmarkEnabled()) ? "game" : "dosowisko";
+	if (IsStartupBenchmarkEnabled()) {
+		LoadGamestate(game, "dosowisko"); // loaded to be measured, but never started
+	}
+	if (bench.golden) {
+		LoadGamestate(game, "game"); // loaded up front, so the intro scene switches to it without a loading screen
+	}
+	LoadGamestate(game, gamestate);
+	StartGamestate(game, gamestate);
 
 	game->data = CreateGameData(game);
+	ParseFramePacingArguments(game->data->scheduler, argc, argv);
 
-	return libsuperderpy_run(game);
+	InitAllocationTracking(alloc_check);
+	if (bench.golden) {
+		InitRenderBenchmark(game, bench);
+	}
+	MarkStartupPhase("game data");
+	int ret = libsuperderpy_run(game);
+	if (FinishAllocationTracking()) {
+		ret = 1;
+	}
+	if (FinishRenderBenchmark()) {
+		ret = 1;
+	}
+	if (FinishStartupBenchmark()) {
+		ret = 1;
+	}
+	return ret;
 }
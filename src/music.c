@@ -0,0 +1,355 @@
+/*! \file music.c
+ *  \brief Background music streaming.
+ *
+ *  The music file is decoded ahead of time on a dedicated thread into a
+ *  lock-free ring buffer that holds [Audio] music_buffer milliseconds of
+ *  audio. A second, lightweight thread wakes up whenever the mixer releases
+ *  a fragment of the output stream and refills it straight from the ring, so
+ *  a hitch in decoding (or anywhere else) only eats into the buffer instead
+ *  of being heard. Output latency is controlled by [Audio] music_latency.
+ *
+ *  When the decoder isn't available the file is streamed with Allegro as
+ *  before.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "music.h"
+#include <libsuperderpy.h>
+#include <stdatomic.h>
+#ifdef MUSIC_DECODER_SUPPORTED
+#include <FLAC/stream_decoder.h>
+#endif
+
+#define FALLBACK_BUFFERS 4
+#define FALLBACK_SAMPLES 2048
+#define OUTPUT_FRAGMENTS 2
+#define LOW_WATER 4 // the buffer counts as near empty below 1/LOW_WATER of its size
+#define MAX_BLOCK 65535 // largest block size allowed by the FLAC format
+
+struct MusicStream {
+	struct Game* game;
+	ALLEGRO_AUDIO_STREAM* stream;
+#ifdef MUSIC_DECODER_SUPPORTED
+	ALLEGRO_FILE* file;
+	FLAC__StreamDecoder* decoder;
+	ALLEGRO_THREAD *decode_thread, *feed_thread;
+
+	unsigned frequency, max_block;
+	int channels, shift;
+
+	int16_t* ring;
+	size_t capacity; // in frames, always a power of two
+	size_t fragment; // frames per output fragment
+	atomic_size_t head, tail; // frames written and read so far; only ever grow
+
+	atomic_int underruns, loops;
+	atomic_size_t near_empty; // in frames
+#endif
+};
+
+#ifdef MUSIC_DECODER_SUPPORTED
+
+static FLAC__StreamDecoderReadStatus ReadCallback(const FLAC__StreamDecoder* decoder, FLAC__byte buffer[], size_t* bytes, void* userdata) {
+	struct MusicStream* music = userdata;
+	*bytes = al_fread(music->file, buffer, *bytes);
+	if (!*bytes) {
+		return al_feof(music->file) ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+	}
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderSeekStatus SeekCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64 offset, void* userdata) {
+	struct MusicStream* music = userdata;
+	return al_fseek(music->file, offset, ALLEGRO_SEEK_SET) ? FLAC__STREAM_DECODER_SEEK_STATUS_OK : FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+}
+
+static FLAC__StreamDecoderTellStatus TellCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64* offset, void* userdata) {
+	struct MusicStream* music = userdata;
+	int64_t pos = al_ftell(music->file);
+	if (pos < 0) {
+		return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
+	}
+	*offset = pos;
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus LengthCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64* length, void* userdata) {
+	struct MusicStream* music = userdata;
+	int64_t size = al_fsize(music->file);
+	if (size < 0) {
+		return FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED;
+	}
+	*length = size;
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool EofCallback(const FLAC__StreamDecoder* decoder, void* userdata) {
+	struct MusicStream* music = userdata;
+	return al_feof(music->file);
+}
+
+static FLAC__StreamDecoderWriteStatus WriteCallback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* userdata) {
+	// Only called from DecodeBlock, which makes sure there's room for a whole block.
+	struct MusicStream* music = userdata;
+	size_t head = atomic_load_explicit(&music->head, memory_order_relaxed);
+	for (unsigned i = 0; i < frame->header.blocksize; i++) {
+		int16_t* out = &music->ring[((head + i) & (music->capacity - 1)) * music->channels];
+		for (int c = 0; c < music->channels; c++) {
+			out[c] = (music->shift >= 0) ? (buffer[c][i] >> music->shift) : (buffer[c][i] * (1 << -music->shift));
+		}
+	}
+	atomic_store_explicit(&music->head, head + frame->header.blocksize, memory_order_release);
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void MetadataCallback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* userdata) {
+	struct MusicStream* music = userdata;
+	if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+		music->frequency = metadata->data.stream_info.sample_rate;
+		music->channels = metadata->data.stream_info.channels;
+		music->shift = metadata->data.stream_info.bits_per_sample - 16;
+		music->max_block = metadata->data.stream_info.max_blocksize;
+	}
+}
+
+static void ErrorCallback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* userdata) {
+	struct MusicStream* music = userdata;
+	PrintConsole(music->game, "Music: decoding error: %s", FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+static size_t FreeFrames(struct MusicStream* music) {
+	return music->capacity - (atomic_load_explicit(&music->head, memory_order_relaxed) - atomic_load_explicit(&music->tail, memory_order_acquire));
+}
+
+static bool DecodeBlock(struct MusicStream* music) {
+	if (FLAC__stream_decoder_get_state(music->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) {
+		// FLAC is sample exact, so carrying on from the start right after the
+		// last sample in the ring gives the same gapless loop as ALLEGRO_PLAYMODE_LOOP
+		if (!FLAC__stream_decoder_reset(music->decoder)) {
+			return false;
+		}
+		atomic_fetch_add(&music->loops, 1);
+	}
+	return FLAC__stream_decoder_process_single(music->decoder);
+}
+
+static void* DecodeThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct MusicStream* music = arg;
+	double nap = fmin(music->max_block, music->fragment) / (double)music->frequency / 2.0;
+	while (!al_get_thread_should_stop(thread)) {
+		if (FreeFrames(music) < music->max_block) {
+			al_rest(nap);
+			continue;
+		}
+		if (!DecodeBlock(music)) {
+			PrintConsole(music->game, "Music: decoder stopped: %s", FLAC__stream_decoder_get_resolved_state_string(music->decoder));
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void FillFragments(struct MusicStream* music) {
+	int16_t* fragment;
+	while ((fragment = al_get_audio_stream_fragment(music->stream))) {
+		size_t tail = atomic_load_explicit(&music->tail, memory_order_relaxed);
+		size_t available = atomic_load_explicit(&music->head, memory_order_acquire) - tail;
+		size_t count = (available < music->fragment) ? available : music->fragment;
+
+		for (size_t done = 0; done < count;) {
+			size_t pos = (tail + done) & (music->capacity - 1);
+			size_t chunk = (count - done < music->capacity - pos) ? (count - done) : (music->capacity - pos);
+			memcpy(fragment + done * music->channels, music->ring + pos * music->channels, chunk * music->channels * sizeof(int16_t));
+			done += chunk;
+		}
+		atomic_store_explicit(&music->tail, tail + count, memory_order_release);
+
+		if (count < music->fragment) {
+			memset(fragment + count * music->channels, 0, (music->fragment - count) * music->channels * sizeof(int16_t));
+			atomic_fetch_add(&music->underruns, 1);
+		}
+		if (available < music->capacity / LOW_WATER) {
+			atomic_fetch_add(&music->near_empty, music->fragment);
+		}
+		al_set_audio_stream_fragment(music->stream, fragment);
+	}
+}
+
+static void* FeedThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct MusicStream* music = arg;
+	ALLEGRO_EVENT_QUEUE* queue = al_create_event_queue();
+	al_register_event_source(queue, al_get_audio_stream_event_source(music->stream));
+	FillFragments(music);
+	while (!al_get_thread_should_stop(thread)) {
+		ALLEGRO_EVENT ev;
+		if (al_wait_for_event_timed(queue, &ev, 0.1)) {
+			FillFragments(music);
+		}
+	}
+	al_destroy_event_queue(queue);
+	return NULL;
+}
+
+static void CloseDecoder(struct MusicStream* music) {
+	if (music->decoder) {
+		FLAC__stream_decoder_delete(music->decoder);
+		music->decoder = NULL;
+	}
+	if (music->file) {
+		al_fclose(music->file);
+		music->file = NULL;
+	}
+	free(music->ring);
+	music->ring = NULL;
+}
+
+static bool OpenDecoder(struct MusicStream* music, const char* path) {
+	music->file = al_fopen(path, "rb");
+	if (!music->file) {
+		return false;
+	}
+	music->decoder = FLAC__stream_decoder_new();
+	if (!music->decoder ||
+		FLAC__stream_decoder_init_stream(music->decoder, ReadCallback, SeekCallback, TellCallback, LengthCallback, EofCallback,
+			WriteCallback, MetadataCallback, ErrorCallback, music) != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+		!FLAC__stream_decoder_process_until_end_of_metadata(music->decoder) ||
+		!music->frequency || music->channels < 1 || music->channels > 2) {
+		CloseDecoder(music);
+		return false;
+	}
+	if (!music->max_block) {
+		music->max_block = MAX_BLOCK;
+	}
+
+	int buffer = strtol(GetConfigOptionDefault(music->game, "Audio", "music_buffer", "500"), NULL, 10);
+	int latency = strtol(GetConfigOptionDefault(music->game, "Audio", "music_latency", "40"), NULL, 10);
+	music->fragment = fmax(64, music->frequency * latency / 1000 / OUTPUT_FRAGMENTS);
+	size_t wanted = music->frequency * (size_t)buffer / 1000;
+	if (wanted < music->max_block * 2) {
+		wanted = music->max_block * 2;
+	}
+	if (wanted < music->fragment * 2) {
+		wanted = music->fragment * 2;
+	}
+	music->capacity = 1;
+	while (music->capacity < wanted) {
+		music->capacity *= 2;
+	}
+	music->ring = malloc(music->capacity * music->channels * sizeof(int16_t));
+	atomic_init(&music->head, 0);
+	atomic_init(&music->tail, 0);
+	atomic_init(&music->underruns, 0);
+	atomic_init(&music->loops, 0);
+	atomic_init(&music->near_empty, 0);
+
+	// start with a full buffer, so the first fragments aren't counted as underruns
+	while (FreeFrames(music) >= music->max_block) {
+		if (!DecodeBlock(music)) {
+			CloseDecoder(music);
+			return false;
+		}
+	}
+
+	music->stream = al_create_audio_stream(OUTPUT_FRAGMENTS, music->fragment, music->frequency, ALLEGRO_AUDIO_DEPTH_INT16,
+		(music->channels == 2) ? ALLEGRO_CHANNEL_CONF_2 : ALLEGRO_CHANNEL_CONF_1);
+	if (!music->stream) {
+		CloseDecoder(music);
+		return false;
+	}
+	PrintConsole(music->game, "Music: %s, %u Hz, %d ms ahead, %d ms latency", path, music->frequency,
+		(int)(music->capacity * 1000 / music->frequency), (int)(music->fragment * OUTPUT_FRAGMENTS * 1000 / music->frequency));
+	return true;
+}
+
+#endif
+
+struct MusicStream* CreateMusicStream(struct Game* game, const char* path, ALLEGRO_MIXER* mixer) {
+	struct MusicStream* music = calloc(1, sizeof(struct MusicStream));
+	music->game = game;
+
+#ifdef MUSIC_DECODER_SUPPORTED
+	if (OpenDecoder(music, path)) {
+		al_set_audio_stream_playing(music->stream, false);
+		al_attach_audio_stream_to_mixer(music->stream, mixer);
+		music->decode_thread = al_create_thread(DecodeThread, music);
+		music->feed_thread = al_create_thread(FeedThread, music);
+		al_start_thread(music->decode_thread);
+		al_start_thread(music->feed_thread);
+		return music;
+	}
+	PrintConsole(game, "Music: can't decode %s ahead, streaming it with Allegro instead", path);
+#endif
+
+	music->stream = al_load_audio_stream(path, FALLBACK_BUFFERS, FALLBACK_SAMPLES);
+	if (!music->stream) {
+		PrintConsole(game, "Music: could not load %s!", path);
+		free(music);
+		return NULL;
+	}
+	al_set_audio_stream_playing(music->stream, false);
+	al_set_audio_stream_playmode(music->stream, ALLEGRO_PLAYMODE_LOOP);
+	al_attach_audio_stream_to_mixer(music->stream, mixer);
+	return music;
+}
+
+void DestroyMusicStream(struct MusicStream* music) {
+#ifdef MUSIC_DECODER_SUPPORTED
+	if (music->decoder) {
+		al_join_thread(music->feed_thread, NULL);
+		al_join_thread(music->decode_thread, NULL);
+		al_destroy_thread(music->feed_thread);
+		al_destroy_thread(music->decode_thread);
+
+		struct MusicStats stats = GetMusicStats(music);
+		PrintConsole(music->game, "Music: %d underruns, %.2f s near empty, looped %d times", stats.underruns, stats.near_empty, stats.loops);
+	}
+#endif
+	al_destroy_audio_stream(music->stream);
+#ifdef MUSIC_DECODER_SUPPORTED
+	CloseDecoder(music);
+#endif
+	free(music);
+}
+
+void SetMusicPlaying(struct MusicStream* music, bool playing) {
+	al_set_audio_stream_playing(music->stream, playing);
+}
+
+void SetMusicGain(struct MusicStream* music, float gain) {
+	al_set_audio_stream_gain(music->stream, gain);
+}
+
+float GetMusicGain(struct MusicStream* music) {
+	return al_get_audio_stream_gain(music->stream);
+}
+
+struct MusicStats GetMusicStats(struct MusicStream* music) {
+	struct MusicStats stats = {0};
+	stats.memory = al_get_audio_stream_fragments(music->stream) * al_get_audio_stream_length(music->stream) *
+		al_get_channel_count(al_get_audio_stream_channels(music->stream)) * al_get_audio_depth_size(al_get_audio_stream_depth(music->stream));
+#ifdef MUSIC_DECODER_SUPPORTED
+	if (music->decoder) {
+		stats.memory += music->capacity * music->channels * sizeof(int16_t);
+		stats.underruns = atomic_load(&music->underruns);
+		stats.loops = atomic_load(&music->loops);
+		stats.near_empty = atomic_load(&music->near_empty) / (double)music->frequency;
+		stats.buffered = (atomic_load(&music->head) - atomic_load(&music->tail)) / (double)music->frequency;
+	}
+#endif
+	return stats;
+}
@@ -0,0 +1,43 @@
+/*! \file music.h
+ *  \brief Background music streaming.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_MUSIC_H
+#define SECRETSANTA_MUSIC_H
+
+#include <libsuperderpy.h>
+
+struct MusicStream;
+
+struct MusicStats {
+	int underruns; // fragments that had to be padded with silence
+	double near_empty; // seconds played with less than a quarter of the buffer left
+	double buffered; // seconds decoded ahead right now
+	int loops;
+	size_t memory; // bytes held in buffers
+};
+
+struct MusicStream* CreateMusicStream(struct Game* game, const char* path, ALLEGRO_MIXER* mixer);
+void DestroyMusicStream(struct MusicStream* music);
+void SetMusicPlaying(struct MusicStream* music, bool playing);
+void SetMusicGain(struct MusicStream* music, float gain);
+float GetMusicGain(struct MusicStream* music);
+struct MusicStats GetMusicStats(struct MusicStream* music);
+
+#endif
@@ -0,0 +1,598 @@
+/*! \file netplay.c
+ *  \brief Peer-to-peer rollback netcode over UDP.
+ *
+ *  Both peers run the same deterministic simulation. Remote input that hasn't
+ *  arrived yet is predicted by repeating the last known one; when the real
+ *  input turns out to be different, the state saved before the mispredicted
+ *  tick is restored and all the ticks since then get simulated again.
+ *
+ *  A snapshot gets taken on every tick, so only the part of the state that's
+ *  in use gets copied; for the game that's the drones up to the highest
+ *  enabled one rather than the whole fixed-size array. Snapshots only get
+ *  checksummed once their tick no longer depends on predictions and the
+ *  checksum gets compared with the peer, so re-simulation doesn't hash at all.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netplay.h"
+#include <libsuperderpy.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#if !defined(__EMSCRIPTEN__)
+#define NETPLAY_SUPPORTED
+#endif
+#endif
+
+#ifdef NETPLAY_SUPPORTED
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define INPUT_RING 64
+#define MAX_INPUTS_PER_PACKET 32
+#define MAX_PACKET_SIZE (32 + MAX_INPUTS_PER_PACKET * NETPLAY_MAX_INPUT_SIZE)
+#define MAX_DELAYED_PACKETS 128
+#define PACKET_MAGIC 0x53534e50 // "SSNP"
+
+enum PacketType {
+	PACKET_HELLO,
+	PACKET_INPUT,
+};
+
+struct InputSlot {
+	int32_t tick;
+	bool confirmed;
+	uint8_t bytes[NETPLAY_MAX_INPUT_SIZE];
+};
+
+struct DelayedPacket {
+	double due;
+	size_t size;
+	uint8_t buffer[MAX_PACKET_SIZE];
+};
+
+struct NetplaySession {
+	struct Game* game;
+	struct NetplayConfig config;
+	int socket;
+#ifdef NETPLAY_SUPPORTED
+	struct sockaddr_storage peer;
+	socklen_t peer_len;
+#endif
+
+	size_t state_size, input_size;
+	NetplaySimulateFunc* simulate;
+	NetplayUsedSizeFunc* used_size;
+	void* userdata;
+
+	uint32_t seed;
+	bool synced, heard;
+
+	int32_t tick; // next tick to simulate
+	int32_t remote_confirmed; // last remote tick for which all preceding inputs have arrived
+	int32_t peer_ack; // last local tick the peer has confirmed
+	int32_t rollback; // earliest tick with a misprediction, INT32_MAX if none
+	uint8_t remote_last[NETPLAY_MAX_INPUT_SIZE];
+
+	uint8_t* states; // NETPLAY_ROLLBACK_WINDOW snapshots taken before simulating a tick
+	uint32_t checksums[NETPLAY_ROLLBACK_WINDOW];
+	int32_t checksum_ticks[NETPLAY_ROLLBACK_WINDOW]; // tick of the snapshot each checksum was computed from, -1 if none
+	size_t sizes[NETPLAY_ROLLBACK_WINDOW]; // bytes saved in each snapshot
+	struct InputSlot inputs[NETPLAY_MAX_PLAYERS][INPUT_RING];
+
+	struct DelayedPacket delayed[MAX_DELAYED_PACKETS];
+	int delayed_count;
+
+	double last_hello;
+	struct NetplayStats stats;
+};
+
+static uint32_t Checksum(const uint8_t* data, size_t size) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void PutU32(uint8_t* buffer, uint32_t value) {
+	buffer[0] = (value >> 24) & 0xff;
+	buffer[1] = (value >> 16) & 0xff;
+	buffer[2] = (value >> 8) & 0xff;
+	buffer[3] = value & 0xff;
+}
+
+static uint32_t GetU32(const uint8_t* buffer) {
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+static uint8_t* GetState(struct NetplaySession* session, int32_t tick) {
+	return session->states + (tick % NETPLAY_ROLLBACK_WINDOW) * session->state_size;
+}
+
+static uint32_t GetChecksum(struct NetplaySession* session, int32_t tick) {
+	// Only asked for ticks that won't be re-simulated anymore, so the result stays valid.
+	int slot = tick % NETPLAY_ROLLBACK_WINDOW;
+	if (session->checksum_ticks[slot] != tick) {
+		session->checksums[slot] = Checksum(GetState(session, tick), session->sizes[slot]);
+		session->checksum_ticks[slot] = tick;
+	}
+	return session->checksums[slot];
+}
+
+static size_t GetUsedSize(struct NetplaySession* session, const void* state) {
+	return session->used_size ? session->used_size(state) : session->state_size;
+}
+
+static struct InputSlot* GetInput(struct NetplaySession* session, int player, int32_t tick) {
+	return &session->inputs[player][tick % INPUT_RING];
+}
+
+bool NetplayGetConfig(struct Game* game, struct NetplayConfig* config) {
+	const char* peer = GetConfigOption(game, "Netplay", "peer");
+	config->loopback = strtol(GetConfigOptionDefault(game, "Netplay", "loopback", "0"), NULL, 10);
+	if (config->loopback) {
+		peer = "127.0.0.1";
+	}
+	if (!peer) {
+		return false;
+	}
+	strncpy(config->peer, peer, sizeof(config->peer) - 1);
+	config->peer[sizeof(config->peer) - 1] = 0;
+	config->player = strtol(GetConfigOptionDefault(game, "Netplay", "player", "0"), NULL, 10) ? 1 : 0;
+	config->port = strtol(GetConfigOptionDefault(game, "Netplay", "port", config->player ? "7778" : "7777"), NULL, 10);
+	config->peer_port = strtol(GetConfigOptionDefault(game, "Netplay", "peer_port", config->player ? "7777" : "7778"), NULL, 10);
+	config->delay = strtol(GetConfigOptionDefault(game, "Netplay", "delay", "2"), NULL, 10);
+	config->latency = strtod(GetConfigOptionDefault(game, "Netplay", "latency", "0"), NULL) / 1000.0;
+	config->jitter = strtod(GetConfigOptionDefault(game, "Netplay", "jitter", "0"), NULL) / 1000.0;
+	config->loss = strtod(GetConfigOptionDefault(game, "Netplay", "loss", "0"), NULL) / 100.0;
+	if (config->delay < 0) {
+		config->delay = 0;
+	}
+	if (config->delay > NETPLAY_ROLLBACK_WINDOW / 2) {
+		config->delay = NETPLAY_ROLLBACK_WINDOW / 2;
+	}
+	return true;
+}
+
+#ifdef NETPLAY_SUPPORTED
+
+static void SendRaw(struct NetplaySession* session, const uint8_t* buffer, size_t size) {
+	sendto(session->socket, buffer, size, 0, (struct sockaddr*)&session->peer, session->peer_len);
+}
+
+static void Send(struct NetplaySession* session, const uint8_t* buffer, size_t size) {
+	if (!session->config.latency && !session->config.jitter && !session->config.loss) {
+		SendRaw(session, buffer, size);
+		return;
+	}
+
+	// link conditioner
+	if (rand() / (double)RAND_MAX < session->config.loss) {
+		return;
+	}
+	if (session->delayed_count == MAX_DELAYED_PACKETS) {
+		return;
+	}
+	struct DelayedPacket* packet = &session->delayed[session->delayed_count++];
+	packet->due = al_get_time() + session->config.latency + rand() / (double)RAND_MAX * session->config.jitter;
+	packet->size = size;
+	memcpy(packet->buffer, buffer, size);
+}
+
+static void FlushDelayed(struct NetplaySession* session) {
+	double now = al_get_time();
+	for (int i = 0; i < session->delayed_count; i++) {
+		if (session->delayed[i].due <= now) {
+			SendRaw(session, session->delayed[i].buffer, session->delayed[i].size);
+			session->delayed[i] = session->delayed[--session->delayed_count];
+			i--;
+		}
+	}
+}
+
+static size_t WriteHeader(struct NetplaySession* session, uint8_t* buffer, enum PacketType type) {
+	PutU32(buffer, PACKET_MAGIC);
+	buffer[4] = type;
+	buffer[5] = session->config.player;
+	return 6;
+}
+
+static void SendHello(struct NetplaySession* session) {
+	uint8_t buffer[MAX_PACKET_SIZE];
+	size_t size = WriteHeader(session, buffer, PACKET_HELLO);
+	PutU32(buffer + size, session->seed);
+	size += 4;
+	Send(session, buffer, size);
+	session->last_hello = al_get_time();
+}
+
+static void SendInputs(struct NetplaySession* session) {
+	uint8_t buffer[MAX_PACKET_SIZE];
+	int player = session->config.player;
+	int32_t last = session->tick + session->config.delay - 1;
+	int32_t first = session->peer_ack + 1;
+	if (first < last - INPUT_RING + 1) {
+		first = last - INPUT_RING + 1;
+	}
+	int count = last - first + 1;
+	if (count > MAX_INPUTS_PER_PACKET) {
+		count = MAX_INPUTS_PER_PACKET;
+	}
+	if (count < 0) {
+		count = 0;
+	}
+
+	// the newest state that no longer depends on predictions, used to detect desyncs
+	int32_t check = session->remote_confirmed + 1;
+	if (check > session->tick - 1) {
+		check = session->tick - 1;
+	}
+
+	size_t size = WriteHeader(session, buffer, PACKET_INPUT);
+	PutU32(buffer + size, session->remote_confirmed);
+	size += 4;
+	PutU32(buffer + size, first);
+	size += 4;
+	buffer[size++] = count;
+	PutU32(buffer + size, check);
+	size += 4;
+	PutU32(buffer + size, (check >= 0 && check > session->tick - NETPLAY_ROLLBACK_WINDOW) ? GetChecksum(session, check) : 0);
+	size += 4;
+	for (int i = 0; i < count; i++) {
+		memcpy(buffer + size, GetInput(session, player, first + i)->bytes, session->input_size);
+		size += session->input_size;
+	}
+	Send(session, buffer, size);
+}
+
+static void AdvanceRemoteConfirmed(struct NetplaySession* session) {
+	int remote = !session->config.player;
+	while (true) {
+		struct InputSlot* slot = GetInput(session, remote, session->remote_confirmed + 1);
+		if (!slot->confirmed || slot->tick != session->remote_confirmed + 1) {
+			break;
+		}
+		session->remote_confirmed++;
+		memcpy(session->remote_last, slot->bytes, session->input_size);
+	}
+}
+
+static void ReceiveInputs(struct NetplaySession* session, const uint8_t* buffer, size_t size) {
+	int remote = !session->config.player;
+	if (size < 6 + 17) {
+		return;
+	}
+	const uint8_t* ptr = buffer + 6;
+	int32_t ack = GetU32(ptr);
+	int32_t first = GetU32(ptr + 4);
+	int count = ptr[8];
+	int32_t check = GetU32(ptr + 9);
+	uint32_t checksum = GetU32(ptr + 13);
+	ptr += 17;
+	if (size < 6 + 17 + count * session->input_size) {
+		return;
+	}
+
+	if (ack > session->peer_ack) {
+		session->peer_ack = ack;
+	}
+
+	for (int i = 0; i < count; i++, ptr += session->input_size) {
+		int32_t tick = first + i;
+		if (tick <= session->remote_confirmed) {
+			continue;
+		}
+		if (tick >= session->remote_confirmed + INPUT_RING) {
+			break;
+		}
+		struct InputSlot* slot = GetInput(session, remote, tick);
+		if (slot->tick == tick && slot->confirmed) {
+			continue;
+		}
+		if (tick < session->tick) {
+			// this tick has already been simulated with a predicted input
+			if (slot->tick != tick || memcmp(slot->bytes, ptr, session->input_size) != 0) {
+				if (tick < session->rollback) {
+					session->rollback = tick;
+				}
+			}
+		}
+		slot->tick = tick;
+		slot->confirmed = true;
+		memcpy(slot->bytes, ptr, session->input_size);
+	}
+	AdvanceRemoteConfirmed(session);
+
+	if (check >= 0 && check <= session->remote_confirmed + 1 && check < session->tick && check > session->tick - NETPLAY_ROLLBACK_WINDOW && check > 0) {
+		if (session->rollback > check && GetChecksum(session, check) != checksum) {
+			if (!session->stats.desyncs) {
+				PrintConsole(session->game, "Netplay: desync detected at tick %d!", check);
+			}
+			session->stats.desyncs++;
+		}
+	}
+}
+
+void NetplayPoll(struct NetplaySession* session) {
+	uint8_t buffer[MAX_PACKET_SIZE];
+	ssize_t size;
+	while ((size = recv(session->socket, buffer, sizeof(buffer), 0)) > 0) {
+		if (size < 6 || GetU32(buffer) != PACKET_MAGIC || buffer[5] == session->config.player) {
+			continue;
+		}
+		switch (buffer[4]) {
+			case PACKET_HELLO:
+				if (size < 10) {
+					break;
+				}
+				if (!session->synced) {
+					if (session->config.player) {
+						session->seed = GetU32(buffer + 6);
+					}
+					session->synced = true;
+					PrintConsole(session->game, "Netplay: connected to %s:%d as player %d, seed %u", session->config.peer, session->config.peer_port, session->config.player + 1, session->seed);
+				}
+				break;
+			case PACKET_INPUT:
+				if (session->synced) {
+					session->heard = true;
+					ReceiveInputs(session, buffer, size);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	// keep greeting until the peer starts sending its inputs
+	if (!session->heard && al_get_time() - session->last_hello > 0.1) {
+		SendHello(session);
+	}
+	FlushDelayed(session);
+}
+
+struct NetplaySession* NetplayCreate(struct Game* game, struct NetplayConfig* config, size_t state_size, size_t input_size, NetplaySimulateFunc* simulate, NetplayUsedSizeFunc* used_size, void* userdata) {
+	if (input_size > NETPLAY_MAX_INPUT_SIZE) {
+		PrintConsole(game, "Netplay: input too big (%zu bytes)", input_size);
+		return NULL;
+	}
+
+	struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM}, *result;
+	char port[16];
+	snprintf(port, sizeof(port), "%d", config->peer_port);
+	if (getaddrinfo(config->peer, port, &hints, &result) != 0) {
+		PrintConsole(game, "Netplay: could not resolve %s", config->peer);
+		return NULL;
+	}
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(config->port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+	if (sock < 0 || bind(sock, (struct sockaddr*)&local, sizeof(local)) != 0) {
+		PrintConsole(game, "Netplay: could not bind to port %d", config->port);
+		if (sock >= 0) {
+			close(sock);
+		}
+		freeaddrinfo(result);
+		return NULL;
+	}
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+	struct NetplaySession* session = calloc(1, sizeof(struct NetplaySession));
+	session->game = game;
+	session->config = *config;
+	session->socket = sock;
+	memcpy(&session->peer, result->ai_addr, result->ai_addrlen);
+	session->peer_len = result->ai_addrlen;
+	freeaddrinfo(result);
+
+	session->state_size = state_size;
+	session->input_size = input_size;
+	session->simulate = simulate;
+	session->used_size = used_size;
+	session->userdata = userdata;
+	session->states = calloc(NETPLAY_ROLLBACK_WINDOW, state_size);
+	session->seed = rand();
+	session->remote_confirmed = -1;
+	session->peer_ack = -1;
+	session->rollback = INT32_MAX;
+	for (int p = 0; p < NETPLAY_MAX_PLAYERS; p++) {
+		for (int i = 0; i < INPUT_RING; i++) {
+			session->inputs[p][i].tick = -1;
+		}
+	}
+	for (int i = 0; i < NETPLAY_ROLLBACK_WINDOW; i++) {
+		session->checksum_ticks[i] = -1;
+	}
+	// the first ticks are covered by input delay, so they're known in advance
+	for (int p = 0; p < NETPLAY_MAX_PLAYERS; p++) {
+		for (int i = 0; i < session->config.delay; i++) {
+			session->inputs[p][i].tick = i;
+			session->inputs[p][i].confirmed = true;
+		}
+	}
+	AdvanceRemoteConfirmed(session);
+
+	PrintConsole(game, "Netplay: listening on port %d, waiting for %s:%d", config->port, config->peer, config->peer_port);
+	return session;
+}
+
+void NetplayDestroy(struct NetplaySession* session) {
+	PrintConsole(session->game, "Netplay: %d rollbacks (max %d ticks, %.3f ms), %d stalls, %d desyncs",
+		session->stats.rollbacks, session->stats.max_resimulated, session->stats.max_resimulation_time * 1000.0, session->stats.stalls, session->stats.desyncs);
+	close(session->socket);
+	free(session->states);
+	free(session);
+}
+
+#else
+
+void NetplayPoll(struct NetplaySession* session) {}
+
+struct NetplaySession* NetplayCreate(struct Game* game, struct NetplayConfig* config, size_t state_size, size_t input_size, NetplaySimulateFunc* simulate, NetplayUsedSizeFunc* used_size, void* userdata) {
+	PrintConsole(game, "Netplay: not supported on this platform");
+	return NULL;
+}
+
+void NetplayDestroy(struct NetplaySession* session) {}
+
+static void SendInputs(struct NetplaySession* session) {}
+
+#endif
+
+bool NetplayIsSynced(struct NetplaySession* session) {
+	return session->synced;
+}
+
+uint32_t NetplayGetSeed(struct NetplaySession* session) {
+	return session->seed;
+}
+
+int NetplayGetLocalPlayer(struct NetplaySession* session) {
+	return session->config.player;
+}
+
+struct NetplayStats NetplayGetStats(struct NetplaySession* session) {
+	return session->stats;
+}
+
+static void SimulateTick(struct NetplaySession* session, void* state, int32_t tick) {
+	const void* inputs[NETPLAY_MAX_PLAYERS];
+	for (int p = 0; p < NETPLAY_MAX_PLAYERS; p++) {
+		struct InputSlot* slot = GetInput(session, p, tick);
+		if (slot->tick != tick || !slot->confirmed) {
+			// predict by repeating the last confirmed input
+			slot->tick = tick;
+			slot->confirmed = false;
+			memcpy(slot->bytes, session->remote_last, session->input_size);
+		}
+		inputs[p] = slot->bytes;
+	}
+
+	size_t size = GetUsedSize(session, state);
+	memcpy(GetState(session, tick), state, size);
+	session->sizes[tick % NETPLAY_ROLLBACK_WINDOW] = size;
+	session->checksum_ticks[tick % NETPLAY_ROLLBACK_WINDOW] = -1;
+	session->simulate(state, inputs, session->userdata);
+}
+
+static double Resimulate(struct NetplaySession* session, void* state) {
+	// Restores the snapshot from before the mispredicted tick and simulates forward again; returns the time it took.
+	double start = al_get_time();
+	int count = session->tick - session->rollback;
+	size_t used = GetUsedSize(session, state), size = session->sizes[session->rollback % NETPLAY_ROLLBACK_WINDOW];
+	memcpy(state, GetState(session, session->rollback), size);
+	if (used > size) {
+		// whatever got used since the snapshot was taken has to go back to how it was before
+		memset((uint8_t*)state + size, 0, used - size);
+	}
+	for (int32_t tick = session->rollback; tick < session->tick; tick++) {
+		SimulateTick(session, state, tick);
+	}
+	double time = al_get_time() - start;
+
+	session->stats.rollbacks++;
+	if (count > session->stats.max_resimulated) {
+		session->stats.max_resimulated = count;
+	}
+	if (time > session->stats.max_resimulation_time) {
+		session->stats.max_resimulation_time = time;
+	}
+	return time;
+}
+
+bool NetplayAdvance(struct NetplaySession* session, void* state, const void* input) {
+	NetplayPoll(session);
+	if (!session->synced) {
+		return false;
+	}
+
+	if (session->rollback < session->tick) {
+		if (session->rollback <= session->tick - NETPLAY_ROLLBACK_WINDOW) {
+			// can't happen as long as we stall in time, but don't make it worse if it does
+			PrintConsole(session->game, "Netplay: misprediction at tick %d is too old to roll back!", session->rollback);
+			session->stats.desyncs++;
+		} else {
+			int count = session->tick - session->rollback;
+			double time = Resimulate(session, state);
+			if (time > count * NETPLAY_ROLLBACK_BUDGET / NETPLAY_BUDGET_TICKS) {
+				PrintConsole(session->game, "Netplay: re-simulating %d ticks took %.3f ms", count, time * 1000.0);
+			}
+		}
+	}
+	session->rollback = INT32_MAX;
+
+	if (session->tick - session->remote_confirmed >= NETPLAY_ROLLBACK_WINDOW - 1) {
+		// we're too far ahead of the peer, wait for it to catch up
+		session->stats.stalls++;
+		SendInputs(session);
+		return false;
+	}
+
+	struct InputSlot* slot = GetInput(session, session->config.player, session->tick + session->config.delay);
+	slot->tick = session->tick + session->config.delay;
+	slot->confirmed = true;
+	memcpy(slot->bytes, input, session->input_size);
+
+	SimulateTick(session, state, session->tick);
+	session->tick++;
+
+	SendInputs(session);
+	return true;
+}
+
+void NetplayMeasureRollback(size_t state_size, size_t input_size, NetplaySimulateFunc* simulate, NetplayUsedSizeFunc* used_size, void* userdata, void* state, const void* input, int ticks, int iterations, double* times) {
+	// Runs the same snapshot and re-simulation code as a real match, without any network: every
+	// iteration simulates <ticks> new ticks with all players holding <input>, then rolls all of them back.
+	if (ticks > NETPLAY_ROLLBACK_WINDOW - 1) {
+		ticks = NETPLAY_ROLLBACK_WINDOW - 1;
+	}
+	struct NetplaySession* session = calloc(1, sizeof(struct NetplaySession));
+	session->state_size = state_size;
+	session->input_size = input_size;
+	session->simulate = simulate;
+	session->used_size = used_size;
+	session->userdata = userdata;
+	session->states = calloc(NETPLAY_ROLLBACK_WINDOW, state_size);
+	memcpy(session->remote_last, input, input_size);
+	for (int p = 0; p < NETPLAY_MAX_PLAYERS; p++) {
+		for (int i = 0; i < INPUT_RING; i++) {
+			session->inputs[p][i].tick = -1;
+		}
+	}
+	for (int i = 0; i < NETPLAY_ROLLBACK_WINDOW; i++) {
+		session->checksum_ticks[i] = -1;
+	}
+
+	for (int i = 0; i < iterations; i++) {
+		for (int t = 0; t < ticks; t++) {
+			SimulateTick(session, state, session->tick++);
+		}
+		session->rollback = session->tick - ticks;
+		times[i] = Resimulate(session, state);
+	}
+
+	free(session->states);
+	free(session);
+}
@@ -0,0 +1,70 @@
+/*! \file netplay.h
+ *  \brief Peer-to-peer rollback netcode over UDP.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_NETPLAY_H
+#define SECRETSANTA_NETPLAY_H
+
+#include <libsuperderpy.h>
+
+#define NETPLAY_MAX_PLAYERS 2
+#define NETPLAY_ROLLBACK_WINDOW 16 // ticks that can be re-simulated
+#define NETPLAY_MAX_INPUT_SIZE 16 // bytes
+#define NETPLAY_ROLLBACK_BUDGET 0.001 // seconds allowed for re-simulating NETPLAY_BUDGET_TICKS ticks
+#define NETPLAY_BUDGET_TICKS 8
+
+/*! \brief Simulates a single fixed tick of the shared state using inputs of all players. */
+typedef void NetplaySimulateFunc(void* state, const void* inputs[NETPLAY_MAX_PLAYERS], void* userdata);
+
+/*! \brief Returns how many bytes at the start of the state are in use; only those get saved and checksummed.
+ *  The rest must not affect the simulation once it's zeroed. */
+typedef size_t NetplayUsedSizeFunc(const void* state);
+
+struct NetplayConfig {
+	int player; // 0 hosts the match and picks the seed, 1 joins
+	int port; // local UDP port
+	char peer[256]; // peer host name
+	int peer_port;
+	int delay; // local input delay in ticks
+	bool loopback; // run both peers in the same process
+	// link conditioner, used to test on a single machine
+	double latency, jitter; // seconds
+	double loss; // 0-1
+};
+
+struct NetplayStats {
+	int rollbacks, stalls, desyncs;
+	int max_resimulated; // ticks
+	double max_resimulation_time; // seconds
+};
+
+struct NetplaySession;
+
+bool NetplayGetConfig(struct Game* game, struct NetplayConfig* config);
+struct NetplaySession* NetplayCreate(struct Game* game, struct NetplayConfig* config, size_t state_size, size_t input_size, NetplaySimulateFunc* simulate, NetplayUsedSizeFunc* used_size, void* userdata);
+void NetplayDestroy(struct NetplaySession* session);
+void NetplayPoll(struct NetplaySession* session);
+bool NetplayIsSynced(struct NetplaySession* session);
+uint32_t NetplayGetSeed(struct NetplaySession* session);
+int NetplayGetLocalPlayer(struct NetplaySession* session);
+bool NetplayAdvance(struct NetplaySession* session, void* state, const void* input);
+void NetplayMeasureRollback(size_t state_size, size_t input_size, NetplaySimulateFunc* simulate, NetplayUsedSizeFunc* used_size, void* userdata, void* state, const void* input, int ticks, int iterations, double* times);
+struct NetplayStats NetplayGetStats(struct NetplaySession* session);
+
+#endif
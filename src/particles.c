@@ -0,0 +1,168 @@
+/*! \file particles.c
+ *  \brief GPU-animated particles.
+ *
+ *  Every particle is a quad in a static vertex buffer that only holds its
+ *  corner and a few random seeds. All the motion is computed in the vertex
+ *  shader from those seeds and the current time, so the CPU cost doesn't
+ *  depend on the number of particles and nothing gets uploaded per frame
+ *  other than a handful of uniforms.
+ *
+ *  The trail follows Santa's recent positions, which live in a uniform array
+ *  used as a ring buffer. GLES2 guarantees neither uniform buffers nor
+ *  texture lookups in vertex shaders, so it can't be kept anywhere else on
+ *  the GPU, but uniforms stay in the program between draws: only the slots
+ *  that changed since the last draw get uploaded, usually just the newest.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "particles.h"
+#include <libsuperderpy.h>
+#include <stddef.h>
+
+#define VERTICES_PER_PARTICLE 6
+#define TRAIL_INTERVAL (1 / 30.0)
+#define TIME_PERIOD 3600.0 // keeps the shader's time precise; every motion there repeats over it, so the wrap is seamless
+
+struct ParticleVertex {
+	float x, y;
+	float seed[4];
+};
+
+struct ParticleSystem {
+	struct Game* game;
+	ALLEGRO_SHADER* shader;
+	ALLEGRO_VERTEX_DECL* decl;
+	ALLEGRO_VERTEX_BUFFER* buffer;
+	int start[PARTICLES_KINDS], count[PARTICLES_KINDS];
+
+	struct {
+		float positions[PARTICLES_TRAIL_LENGTH][2]; // ring buffer
+		int head;
+		uint32_t dirty; // a bit per slot that changed since the last upload
+		double time;
+		float alpha;
+	} trail;
+};
+
+static float RandomSeed(uint32_t* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) / (float)(1 << 24);
+}
+
+struct ParticleSystem* CreateParticleSystem(struct Game* game, ALLEGRO_SHADER* shader, const int counts[PARTICLES_KINDS]) {
+	// Has to be called with a GL context available (i.e. in Gamestate_PostLoad).
+	ALLEGRO_VERTEX_ELEMENT elements[] = {
+		{ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_2, offsetof(struct ParticleVertex, x)},
+		{ALLEGRO_PRIM_USER_ATTR, ALLEGRO_PRIM_FLOAT_4, offsetof(struct ParticleVertex, seed)},
+		{0, 0, 0},
+	};
+	static const float corners[VERTICES_PER_PARTICLE][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, -1}, {1, 1}, {-1, 1}};
+
+	struct ParticleSystem* particles = calloc(1, sizeof(struct ParticleSystem));
+	particles->game = game;
+	particles->shader = shader;
+	particles->trail.dirty = UINT32_MAX;
+	particles->decl = al_create_vertex_decl(elements, sizeof(struct ParticleVertex));
+
+	int total = 0;
+	for (int i = 0; i < PARTICLES_KINDS; i++) {
+		particles->start[i] = total;
+		particles->count[i] = counts[i];
+		total += counts[i];
+	}
+
+	struct ParticleVertex* vertices = malloc(sizeof(struct ParticleVertex) * total * VERTICES_PER_PARTICLE);
+	uint32_t state = 0x5eed;
+	for (int i = 0; i < total; i++) {
+		float seed[4] = {RandomSeed(&state), RandomSeed(&state), RandomSeed(&state), RandomSeed(&state)};
+		for (int j = 0; j < VERTICES_PER_PARTICLE; j++) {
+			struct ParticleVertex* vertex = &vertices[i * VERTICES_PER_PARTICLE + j];
+			vertex->x = corners[j][0];
+			vertex->y = corners[j][1];
+			memcpy(vertex->seed, seed, sizeof(seed));
+		}
+	}
+	particles->buffer = al_create_vertex_buffer(particles->decl, vertices, total * VERTICES_PER_PARTICLE, ALLEGRO_PRIM_BUFFER_STATIC);
+	free(vertices);
+
+	if (!particles->buffer) {
+		PrintConsole(game, "Particles: could not create a vertex buffer for %d particles!", total);
+		al_destroy_vertex_decl(particles->decl);
+		free(particles);
+		return NULL;
+	}
+	return particles;
+}
+
+void DestroyParticleSystem(struct ParticleSystem* particles) {
+	al_destroy_vertex_buffer(particles->buffer);
+	al_destroy_vertex_decl(particles->decl);
+	free(particles);
+}
+
+void UpdateParticleTrail(struct ParticleSystem* particles, double time, double x, double y, bool visible) {
+	if (time - particles->trail.time >= TRAIL_INTERVAL) {
+		particles->trail.head = (particles->trail.head + PARTICLES_TRAIL_LENGTH - 1) % PARTICLES_TRAIL_LENGTH;
+		particles->trail.time = (time - particles->trail.time > TRAIL_INTERVAL * 2) ? time : (particles->trail.time + TRAIL_INTERVAL);
+	}
+	particles->trail.positions[particles->trail.head][0] = x;
+	particles->trail.positions[particles->trail.head][1] = y;
+	particles->trail.dirty |= 1u << particles->trail.head;
+	particles->trail.alpha = visible ? fmin(1.0, particles->trail.alpha + 0.05) : fmax(0.0, particles->trail.alpha - 0.05);
+}
+
+bool IsParticleSystemMoving(struct ParticleSystem* particles) {
+	// Stars only twinkle slowly; falling snow and a fading trail need every frame to look smooth.
+	return particles->count[PARTICLES_SNOW] || (particles->count[PARTICLES_TRAIL] && particles->trail.alpha > 0);
+}
+
+void DrawParticles(struct ParticleSystem* particles, enum ParticleKind kind, ALLEGRO_BITMAP* texture, double time, int shuffle) {
+	if (!particles->count[kind]) {
+		return;
+	}
+
+	al_use_shader(particles->shader);
+	al_set_shader_int("kind", kind);
+	al_set_shader_float("time", fmod(time, TIME_PERIOD));
+	al_set_shader_float("shuffle", shuffle);
+	al_set_shader_bool("textured", texture != NULL);
+	float viewport[2] = {particles->game->viewport.width, particles->game->viewport.height};
+	al_set_shader_float_vector("viewport", 2, viewport, 1);
+	if (texture) {
+		float sprite[2] = {al_get_bitmap_width(texture), al_get_bitmap_height(texture)};
+		al_set_shader_float_vector("sprite", 2, sprite, 1);
+	}
+	if (kind == PARTICLES_TRAIL) {
+		for (int i = 0; i < PARTICLES_TRAIL_LENGTH; i++) {
+			if (particles->trail.dirty & (1u << i)) {
+				char name[16];
+				snprintf(name, sizeof(name), "trail[%d]", i);
+				al_set_shader_float_vector(name, 2, particles->trail.positions[i], 1);
+			}
+		}
+		particles->trail.dirty = 0;
+		al_set_shader_float("trail_head", particles->trail.head);
+		al_set_shader_float("trail_interval", TRAIL_INTERVAL);
+		al_set_shader_float("trail_phase", fmax(0.0, time - particles->trail.time));
+		al_set_shader_float("trail_alpha", particles->trail.alpha);
+	}
+
+	al_draw_vertex_buffer(particles->buffer, texture, particles->start[kind] * VERTICES_PER_PARTICLE,
+		(particles->start[kind] + particles->count[kind]) * VERTICES_PER_PARTICLE, ALLEGRO_PRIM_TRIANGLE_LIST);
+	al_use_shader(NULL);
+}
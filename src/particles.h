@@ -0,0 +1,43 @@
+/*! \file particles.h
+ *  \brief GPU-animated particles.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_PARTICLES_H
+#define SECRETSANTA_PARTICLES_H
+
+#include <libsuperderpy.h>
+
+#define PARTICLES_TRAIL_LENGTH 32 // must match TRAIL_LENGTH in particles_vertex.glsl, and fit the bits of a uint32_t
+
+enum ParticleKind {
+	PARTICLES_STARS,
+	PARTICLES_SNOW,
+	PARTICLES_TRAIL,
+	PARTICLES_KINDS
+};
+
+struct ParticleSystem;
+
+struct ParticleSystem* CreateParticleSystem(struct Game* game, ALLEGRO_SHADER* shader, const int counts[PARTICLES_KINDS]);
+void DestroyParticleSystem(struct ParticleSystem* particles);
+void UpdateParticleTrail(struct ParticleSystem* particles, double time, double x, double y, bool visible);
+bool IsParticleSystemMoving(struct ParticleSystem* particles);
+void DrawParticles(struct ParticleSystem* particles, enum ParticleKind kind, ALLEGRO_BITMAP* texture, double time, int shuffle);
+
+#endif
@@ -0,0 +1,164 @@
+/*! \file resolution.c
+ *  \brief Dynamic resolution scaling.
+ *
+ *  Everything drawn between BeginScaledDraw and EndScaledDraw goes into an
+ *  intermediate bitmap at a fraction of the native resolution, which then
+ *  gets scaled up onto the real target. Anything drawn afterwards (like the
+ *  HUD) stays sharp.
+ *
+ *  The scale is picked by a controller watching the frame intervals reported
+ *  by the frame scheduler: it backs off quickly when frames take longer than
+ *  the budget and probes upwards slowly while they fit. Probing again right
+ *  after a failed attempt would keep the image pumping, so each failure
+ *  doubles the time until the next try.
+ *
+ *  [Graphics] resolution_scale is either "auto" or a fixed scale to pin it
+ *  to; [Graphics] min_resolution_scale limits how low "auto" may go.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+#define SMOOTHING 0.1
+#define OVER_BUDGET 1.1 // average interval, relative to the budget, that makes the scale go down
+#define HITCH 2.5 // longer intervals are hitches or idling rather than load, so they're ignored
+#define DOWN_COOLDOWN 0.25 // seconds for the average to settle after a change
+#define UP_STEP 0.05
+#define PROBE_DELAY 2.0
+#define PROBE_DELAY_MAX 32.0
+
+struct DynamicResolution {
+	struct Game* game;
+	bool pinned;
+	double scale, min;
+
+	double average, last_change, probe_delay;
+	bool probing; // the last change went up
+
+	ALLEGRO_BITMAP *buffer, *target;
+	ALLEGRO_TRANSFORM transform, projection;
+	int clip_x, clip_y, clip_w, clip_h;
+	bool active;
+};
+
+struct DynamicResolution* CreateDynamicResolution(struct Game* game) {
+	struct DynamicResolution* resolution = calloc(1, sizeof(struct DynamicResolution));
+	resolution->game = game;
+	const char* scale = GetConfigOptionDefault(game, "Graphics", "resolution_scale", "auto");
+	resolution->pinned = strcmp(scale, "auto") != 0;
+	resolution->scale = resolution->pinned ? fmax(0.1, fmin(strtod(scale, NULL), 1.0)) : 1.0;
+	resolution->min = fmax(0.1, fmin(strtod(GetConfigOptionDefault(game, "Graphics", "min_resolution_scale", "0.5"), NULL), 1.0));
+	resolution->probe_delay = PROBE_DELAY;
+	resolution->last_change = al_get_time();
+	return resolution;
+}
+
+void DestroyDynamicResolution(struct DynamicResolution* resolution) {
+	if (resolution->buffer) {
+		DestroyBitmapAsset(resolution->game, resolution->buffer);
+	}
+	free(resolution);
+}
+
+static void UpdateScale(struct DynamicResolution* resolution) {
+	double interval, budget;
+	// benchmark scenes have to look the same on every run
+	if (resolution->pinned || GetRenderBenchmarkScene() >= 0 || !GetFrameTiming(resolution->game, &interval, &budget) || interval > budget * HITCH) {
+		return;
+	}
+	double now = al_get_time();
+	resolution->average = resolution->average ? (resolution->average * (1 - SMOOTHING) + interval * SMOOTHING) : interval;
+	double since = now - resolution->last_change;
+
+	if (resolution->average > budget * OVER_BUDGET && since > DOWN_COOLDOWN && resolution->scale > resolution->min) {
+		if (resolution->probing && since < resolution->probe_delay) {
+			resolution->probe_delay = fmin(resolution->probe_delay * 2, PROBE_DELAY_MAX);
+		}
+		// the cost is mostly proportional to the pixel count
+		resolution->scale = fmax(resolution->min, resolution->scale * fmax(0.85, sqrt(budget / resolution->average)));
+		resolution->probing = false;
+		resolution->last_change = now;
+	} else if (resolution->probing && since > resolution->probe_delay) {
+		// the last step up has held up
+		resolution->probing = false;
+		resolution->probe_delay = PROBE_DELAY;
+	} else if (resolution->average <= budget * OVER_BUDGET && since > resolution->probe_delay && resolution->scale < 1.0) {
+		resolution->scale = fmin(1.0, resolution->scale + UP_STEP);
+		resolution->probing = true;
+		resolution->last_change = now;
+	}
+}
+
+void BeginScaledDraw(struct DynamicResolution* resolution) {
+	UpdateScale(resolution);
+	resolution->active = resolution->scale < 1.0;
+	if (!resolution->active) {
+		return;
+	}
+
+	resolution->target = al_get_target_bitmap();
+	int width = al_get_bitmap_width(resolution->target), height = al_get_bitmap_height(resolution->target);
+	if (!resolution->buffer || al_get_bitmap_width(resolution->buffer) != width || al_get_bitmap_height(resolution->buffer) != height) {
+		// allocated at the native size, so changing the scale never needs a new one
+		if (resolution->buffer) {
+			DestroyBitmapAsset(resolution->game, resolution->buffer);
+		}
+		int flags = al_get_new_bitmap_flags();
+		al_set_new_bitmap_flags(flags | ALLEGRO_MAG_LINEAR | ALLEGRO_MIN_LINEAR);
+		CreateRenderTarget(resolution->game, "shared", "resolution buffer", &resolution->buffer, width, height, NULL, NULL);
+		al_set_new_bitmap_flags(flags);
+	}
+
+	al_copy_transform(&resolution->transform, al_get_current_transform());
+	al_copy_transform(&resolution->projection, al_get_current_projection_transform());
+	al_get_clipping_rectangle(&resolution->clip_x, &resolution->clip_y, &resolution->clip_w, &resolution->clip_h);
+
+	// same transformations as the real target, then squeezed towards the top left corner in clip space
+	float scale = resolution->scale;
+	ALLEGRO_TRANSFORM projection;
+	al_copy_transform(&projection, &resolution->projection);
+	al_translate_transform(&projection, 1, -1);
+	al_scale_transform(&projection, scale, scale);
+	al_translate_transform(&projection, -1, 1);
+	al_set_target_bitmap(resolution->buffer);
+	al_use_transform(&resolution->transform);
+	al_use_projection_transform(&projection);
+	al_set_clipping_rectangle(resolution->clip_x * scale, resolution->clip_y * scale, ceil(resolution->clip_w * scale), ceil(resolution->clip_h * scale));
+	al_clear_to_color(al_map_rgb(0, 0, 0));
+}
+
+void EndScaledDraw(struct DynamicResolution* resolution) {
+	if (!resolution->active) {
+		return;
+	}
+	float scale = resolution->scale;
+	al_set_target_bitmap(resolution->target);
+	ALLEGRO_TRANSFORM identity, pixels;
+	al_identity_transform(&identity);
+	al_identity_transform(&pixels);
+	al_orthographic_transform(&pixels, 0, 0, -1, al_get_bitmap_width(resolution->target), al_get_bitmap_height(resolution->target), 1);
+	al_use_transform(&identity);
+	al_use_projection_transform(&pixels);
+	al_set_clipping_rectangle(resolution->clip_x, resolution->clip_y, resolution->clip_w, resolution->clip_h);
+	al_draw_scaled_bitmap(resolution->buffer, resolution->clip_x * scale, resolution->clip_y * scale, resolution->clip_w * scale, resolution->clip_h * scale,
+		resolution->clip_x, resolution->clip_y, resolution->clip_w, resolution->clip_h, 0);
+	al_use_transform(&resolution->transform);
+	al_use_projection_transform(&resolution->projection);
+	resolution->active = false;
+}
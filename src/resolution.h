@@ -0,0 +1,33 @@
+/*! \file resolution.h
+ *  \brief Dynamic resolution scaling.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_RESOLUTION_H
+#define SECRETSANTA_RESOLUTION_H
+
+#include <libsuperderpy.h>
+
+struct DynamicResolution;
+
+struct DynamicResolution* CreateDynamicResolution(struct Game* game);
+void DestroyDynamicResolution(struct DynamicResolution* resolution);
+void BeginScaledDraw(struct DynamicResolution* resolution);
+void EndScaledDraw(struct DynamicResolution* resolution);
+
+#endif
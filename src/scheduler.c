@@ -0,0 +1,378 @@
+/*! \file scheduler.c
+ *  \brief Power-aware frame scheduler and pacer.
+ *
+ *  Gamestates that show a (nearly) static screen can declare themselves idle
+ *  for the current frame with RequestIdle. While they keep doing so, the main
+ *  loop gets put to sleep after each frame until either the idle frame rate
+ *  is due or some input arrives, whichever comes first.
+ *
+ *  Otherwise, frames can be capped to a target rate with a choice of waiting
+ *  strategy. In the delayed simulation ("just in time") mode the wait moves
+ *  from the end of the frame to right before the logic, shortened by the
+ *  predicted cost of the frame, so input is sampled as late as possible
+ *  before drawing. Input that arrives during that wait is handed over to the
+ *  gamestates through PollLateEvent, as the engine would only deliver it in
+ *  the next frame.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+#define IDLE_MAX_WAIT 1.0
+#define AXIS_THRESHOLD 0.5
+#define SPIN_MARGIN 0.002 // how much of the wait gets spun through in hybrid mode
+#define JIT_MARGIN 0.001 // safety margin on top of the predicted frame cost
+#define STATS_FRAMES 120
+#define REPORT_INTERVAL 10.0
+
+static const char* WaitNames[] = {
+	[FRAME_WAIT_SLEEP] = "sleep",
+	[FRAME_WAIT_SPIN] = "spin",
+	[FRAME_WAIT_HYBRID] = "hybrid",
+};
+
+struct FrameScheduler {
+	struct Game* game;
+	ALLEGRO_EVENT_QUEUE* queue; // gets a copy of every input event
+	bool enabled;
+	bool requested, idle;
+	double rate, last_frame, idle_since;
+	int idle_frames;
+
+	struct {
+		double rate; // 0 for uncapped
+		enum FrameWait wait;
+		bool delayed, overlay;
+		double deadline;
+		double frame_start, sample_time, last_sample_time;
+		double work; // smoothed cost of logic and drawing
+	} pacing;
+
+	struct {
+		double intervals[STATS_FRAMES];
+		double latencies[STATS_FRAMES];
+		int count, pos;
+		double last_present, last_report;
+		ALLEGRO_FONT* font;
+	} stats;
+};
+
+struct FrameScheduler* CreateFrameScheduler(struct Game* game) {
+	struct FrameScheduler* scheduler = calloc(1, sizeof(struct FrameScheduler));
+	scheduler->game = game;
+	scheduler->enabled = strtol(GetConfigOptionDefault(game, "Graphics", "idle_throttling", "1"), NULL, 10);
+	scheduler->queue = al_create_event_queue();
+	if (al_is_keyboard_installed()) {
+		al_register_event_source(scheduler->queue, al_get_keyboard_event_source());
+	}
+	if (al_is_mouse_installed()) {
+		al_register_event_source(scheduler->queue, al_get_mouse_event_source());
+	}
+	if (al_is_joystick_installed()) {
+		al_register_event_source(scheduler->queue, al_get_joystick_event_source());
+	}
+	if (al_is_touch_input_installed()) {
+		al_register_event_source(scheduler->queue, al_get_touch_input_event_source());
+	}
+	al_register_event_source(scheduler->queue, al_get_display_event_source(game->display));
+	scheduler->last_frame = al_get_time();
+
+	// the rest of the display setup (vsync) happens before the display gets created, see main.c
+	SetFramePacingOption(scheduler, "fps", GetConfigOptionDefault(game, "Graphics", "fps", "0"));
+	SetFramePacingOption(scheduler, "wait", GetConfigOptionDefault(game, "Graphics", "wait", "hybrid"));
+	SetFramePacingOption(scheduler, "jit", GetConfigOptionDefault(game, "Graphics", "jit", "0"));
+	SetFramePacingOption(scheduler, "show_pacing", GetConfigOptionDefault(game, "Graphics", "show_pacing", "0"));
+	scheduler->stats.last_report = al_get_time();
+	PrintConsole(game, "Pacing: cap %.0f fps, %s wait%s", scheduler->pacing.rate, WaitNames[scheduler->pacing.wait], scheduler->pacing.delayed ? ", delayed simulation" : "");
+	return scheduler;
+}
+
+void DestroyFrameScheduler(struct FrameScheduler* scheduler) {
+	if (scheduler->stats.font) {
+		al_destroy_font(scheduler->stats.font);
+	}
+	al_destroy_event_queue(scheduler->queue);
+	free(scheduler);
+}
+
+bool SetFramePacingOption(struct FrameScheduler* scheduler, const char* name, const char* value) {
+	if (strcmp(name, "fps") == 0) {
+		scheduler->pacing.rate = fmax(0, strtod(value, NULL));
+	} else if (strcmp(name, "wait") == 0) {
+		for (int i = 0; i < FRAME_WAIT_MODES; i++) {
+			if (strcmp(value, WaitNames[i]) == 0) {
+				scheduler->pacing.wait = i;
+				return true;
+			}
+		}
+		PrintConsole(scheduler->game, "Pacing: unknown wait mode \"%s\"", value);
+		return false;
+	} else if (strcmp(name, "jit") == 0) {
+		scheduler->pacing.delayed = strtol(value, NULL, 10);
+	} else if (strcmp(name, "show_pacing") == 0) {
+		scheduler->pacing.overlay = strtol(value, NULL, 10);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void ParseFramePacingArguments(struct FrameScheduler* scheduler, int argc, char** argv) {
+	// --fps=N, --wait=sleep|spin|hybrid, --jit and --show-pacing override the config
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--fps=", 6) == 0) {
+			SetFramePacingOption(scheduler, "fps", argv[i] + 6);
+		} else if (strncmp(argv[i], "--wait=", 7) == 0) {
+			SetFramePacingOption(scheduler, "wait", argv[i] + 7);
+		} else if (strcmp(argv[i], "--jit") == 0) {
+			SetFramePacingOption(scheduler, "jit", "1");
+		} else if (strcmp(argv[i], "--show-pacing") == 0) {
+			SetFramePacingOption(scheduler, "show_pacing", "1");
+		}
+	}
+}
+
+void RequestIdle(struct Game* game, double rate) {
+	// Has to be called every frame (e.g. from Gamestate_Logic) for as long as the screen stays idle.
+	// When several gamestates ask for it, the fastest requested rate wins.
+	struct FrameScheduler* scheduler = game->data ? game->data->scheduler : NULL;
+	if (!scheduler || IsStartupBenchmarkEnabled()) {
+		// the first frame wouldn't get presented until the idle wait is over
+		return;
+	}
+	if (!scheduler->requested || rate > scheduler->rate) {
+		scheduler->rate = rate;
+	}
+	scheduler->requested = true;
+}
+
+bool PollLateEvent(struct Game* game, ALLEGRO_EVENT* ev) {
+	// Only returns anything in the delayed simulation mode. The same events will still be delivered by the
+	// engine later on, so whoever handles them has to skip the ones it has already seen.
+	struct FrameScheduler* scheduler = game->data ? game->data->scheduler : NULL;
+	if (!scheduler || !scheduler->pacing.delayed) {
+		return false;
+	}
+	return al_get_next_event(scheduler->queue, ev);
+}
+
+static bool IsWakeUpEvent(ALLEGRO_EVENT* ev) {
+	// analog sticks tend to report noise all the time
+	if (ev->type == ALLEGRO_EVENT_JOYSTICK_AXIS) {
+		return fabs(ev->joystick.pos) > AXIS_THRESHOLD;
+	}
+	return ev->type != ALLEGRO_EVENT_MOUSE_AXES;
+}
+
+static void WaitForNextFrame(struct FrameScheduler* scheduler) {
+	double deadline = scheduler->last_frame + ((scheduler->rate > 0) ? (1.0 / scheduler->rate) : IDLE_MAX_WAIT);
+	double now = al_get_time();
+	while (now < deadline) {
+		ALLEGRO_EVENT ev;
+		if (al_wait_for_event_timed(scheduler->queue, &ev, deadline - now) && IsWakeUpEvent(&ev)) {
+			break;
+		}
+		now = al_get_time();
+	}
+	al_flush_event_queue(scheduler->queue);
+}
+
+static void WaitUntil(struct FrameScheduler* scheduler, double time) {
+	double now = al_get_time();
+	if (now >= time) {
+		return;
+	}
+	switch (scheduler->pacing.wait) {
+		case FRAME_WAIT_SLEEP:
+			al_rest(time - now);
+			break;
+		case FRAME_WAIT_HYBRID:
+			// the OS scheduler can oversleep by a millisecond or two, so spin through the rest
+			if (time - now > SPIN_MARGIN) {
+				al_rest(time - now - SPIN_MARGIN);
+			}
+			// fallthrough
+		case FRAME_WAIT_SPIN:
+		default:
+			while (al_get_time() < time) {}
+			break;
+	}
+}
+
+static double GetTargetInterval(struct FrameScheduler* scheduler) {
+	if (scheduler->pacing.rate > 0) {
+		return 1.0 / scheduler->pacing.rate;
+	}
+	if (scheduler->pacing.delayed) {
+		// uncapped delayed simulation follows the display
+		int refresh = al_get_display_refresh_rate(scheduler->game->display);
+		return 1.0 / ((refresh > 0) ? refresh : 60);
+	}
+	return 0;
+}
+
+bool GetFrameTiming(struct Game* game, double* interval, double* budget) {
+	// Gives the last present-to-present interval and the one the pacing aims for.
+	// Returns false while idling, as the intervals are stretched on purpose then.
+	struct FrameScheduler* scheduler = game->data ? game->data->scheduler : NULL;
+	if (!scheduler || scheduler->idle || !scheduler->stats.count) {
+		return false;
+	}
+	*interval = scheduler->stats.intervals[(scheduler->stats.pos + STATS_FRAMES - 1) % STATS_FRAMES];
+	*budget = GetTargetInterval(scheduler);
+	if (*budget <= 0) {
+		int refresh = al_get_display_refresh_rate(game->display);
+		*budget = 1.0 / ((refresh > 0) ? refresh : 60);
+	}
+	return true;
+}
+
+static double AdvanceDeadline(struct FrameScheduler* scheduler, double interval, double now) {
+	scheduler->pacing.deadline += interval;
+	if (scheduler->pacing.deadline < now || scheduler->pacing.deadline > now + interval * 2) {
+		// we've missed it (or the rate got changed); start over instead of trying to catch up
+		scheduler->pacing.deadline = now + interval;
+	}
+	return scheduler->pacing.deadline;
+}
+
+void FrameSchedulerPreLogic(struct Game* game, double delta) {
+	struct FrameScheduler* scheduler = game->data ? game->data->scheduler : NULL;
+	if (!scheduler) {
+		return;
+	}
+	double now = al_get_time();
+	double interval = GetTargetInterval(scheduler);
+	if (scheduler->pacing.delayed && interval > 0 && !scheduler->idle) {
+		double deadline = AdvanceDeadline(scheduler, interval, now);
+		WaitUntil(scheduler, deadline - scheduler->pacing.work - JIT_MARGIN);
+		now = al_get_time();
+	}
+	scheduler->pacing.frame_start = now;
+	scheduler->pacing.last_sample_time = scheduler->pacing.sample_time;
+	scheduler->pacing.sample_time = now;
+}
+
+static void GetStats(struct FrameScheduler* scheduler, double* mean, double* jitter, double* latency) {
+	*mean = *jitter = *latency = 0;
+	int count = scheduler->stats.count;
+	if (!count) {
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		*mean += scheduler->stats.intervals[i];
+		*latency += scheduler->stats.latencies[i];
+	}
+	*mean /= count;
+	*latency /= count;
+	for (int i = 0; i < count; i++) {
+		*jitter += pow(scheduler->stats.intervals[i] - *mean, 2);
+	}
+	*jitter = sqrt(*jitter / count);
+}
+
+static void UpdateStats(struct FrameScheduler* scheduler, double present) {
+	if (scheduler->stats.last_present) {
+		// Input arriving anywhere between two samples waits half of that on average before being picked up,
+		// then it takes until the present to reach the screen.
+		double latency = (scheduler->pacing.sample_time - scheduler->pacing.last_sample_time) / 2.0 + (present - scheduler->pacing.sample_time);
+		scheduler->stats.intervals[scheduler->stats.pos] = present - scheduler->stats.last_present;
+		scheduler->stats.latencies[scheduler->stats.pos] = latency;
+		scheduler->stats.pos = (scheduler->stats.pos + 1) % STATS_FRAMES;
+		scheduler->stats.count = fmin(scheduler->stats.count + 1, STATS_FRAMES);
+	}
+	scheduler->stats.last_present = present;
+
+	if (present - scheduler->stats.last_report >= REPORT_INTERVAL) {
+		double mean, jitter, latency;
+		GetStats(scheduler, &mean, &jitter, &latency);
+		PrintConsole(scheduler->game, "Pacing: %.1f fps, interval %.2f ms, jitter %.2f ms, frame cost %.2f ms, input to present ~%.1f ms",
+			mean ? (1.0 / mean) : 0, mean * 1000.0, jitter * 1000.0, scheduler->pacing.work * 1000.0, latency * 1000.0);
+		scheduler->stats.last_report = present;
+	}
+}
+
+static void DrawOverlay(struct FrameScheduler* scheduler) {
+	if (!scheduler->stats.font) {
+		scheduler->stats.font = al_create_builtin_font();
+	}
+	double mean, jitter, latency;
+	GetStats(scheduler, &mean, &jitter, &latency);
+
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	ALLEGRO_TRANSFORM old, transform;
+	al_set_target_backbuffer(scheduler->game->display);
+	al_copy_transform(&old, al_get_current_transform());
+	al_identity_transform(&transform);
+	al_use_transform(&transform);
+	al_draw_filled_rectangle(0, 0, 400, 36, al_map_rgba(0, 0, 0, 160));
+	al_draw_textf(scheduler->stats.font, al_map_rgb(255, 255, 255), 4, 4, ALLEGRO_ALIGN_LEFT, "%.1f fps  jitter %.2f ms  latency ~%.1f ms",
+		mean ? (1.0 / mean) : 0, jitter * 1000.0, latency * 1000.0);
+	al_draw_textf(scheduler->stats.font, al_map_rgb(255, 255, 255), 4, 20, ALLEGRO_ALIGN_LEFT, "cap %.0f  %s%s",
+		scheduler->pacing.rate, WaitNames[scheduler->pacing.wait], scheduler->pacing.delayed ? "  jit" : "");
+	al_use_transform(&old);
+	al_set_target_bitmap(target);
+}
+
+void FrameSchedulerPostDraw(struct Game* game) {
+	struct FrameScheduler* scheduler = game->data ? game->data->scheduler : NULL;
+	if (!scheduler) {
+		return;
+	}
+
+	if (scheduler->pacing.overlay) {
+		DrawOverlay(scheduler);
+	}
+
+	double now = al_get_time();
+	double work = now - scheduler->pacing.frame_start;
+	// react quickly to frames getting more expensive, but only slowly to them getting cheaper
+	scheduler->pacing.work = (work > scheduler->pacing.work) ? work : (scheduler->pacing.work * 0.95 + work * 0.05);
+
+	if (scheduler->requested && scheduler->enabled) {
+		if (!scheduler->idle) {
+			scheduler->idle = true;
+			scheduler->idle_since = now;
+			scheduler->idle_frames = 0;
+		}
+		scheduler->idle_frames++;
+		WaitForNextFrame(scheduler);
+	} else {
+		if (scheduler->idle) {
+			double time = now - scheduler->idle_since;
+			PrintConsole(game, "Scheduler: idle for %.1f s, %d frames (%.1f fps)", time, scheduler->idle_frames, scheduler->idle_frames / fmax(time, 0.001));
+			scheduler->idle = false;
+		}
+		double interval = GetTargetInterval(scheduler);
+		if (interval > 0) {
+			// in the delayed mode the frame should be done right at the deadline already
+			WaitUntil(scheduler, scheduler->pacing.delayed ? scheduler->pacing.deadline : AdvanceDeadline(scheduler, interval, now));
+		}
+		// stale events would cut the next idle frame short
+		al_flush_event_queue(scheduler->queue);
+	}
+
+	scheduler->requested = false;
+	scheduler->last_frame = al_get_time();
+	if (scheduler->idle) {
+		scheduler->stats.last_present = 0;
+	} else {
+		UpdateStats(scheduler, scheduler->last_frame);
+	}
+}
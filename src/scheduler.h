@@ -0,0 +1,47 @@
+/*! \file scheduler.h
+ *  \brief Power-aware frame scheduler.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_SCHEDULER_H
+#define SECRETSANTA_SCHEDULER_H
+
+#include <libsuperderpy.h>
+
+#define IDLE_ON_INPUT 0 // rate for screens that only need redrawing when something happens
+
+enum FrameWait {
+	FRAME_WAIT_SLEEP, // cheapest, but at the mercy of the OS scheduler
+	FRAME_WAIT_SPIN, // most precise, burns a core
+	FRAME_WAIT_HYBRID, // sleeps most of the time, spins through the last bit
+	FRAME_WAIT_MODES
+};
+
+struct FrameScheduler;
+
+struct FrameScheduler* CreateFrameScheduler(struct Game* game);
+void DestroyFrameScheduler(struct FrameScheduler* scheduler);
+bool SetFramePacingOption(struct FrameScheduler* scheduler, const char* name, const char* value);
+void ParseFramePacingArguments(struct FrameScheduler* scheduler, int argc, char** argv);
+void RequestIdle(struct Game* game, double rate);
+bool PollLateEvent(struct Game* game, ALLEGRO_EVENT* ev);
+bool GetFrameTiming(struct Game* game, double* interval, double* budget);
+void FrameSchedulerPreLogic(struct Game* game, double delta);
+void FrameSchedulerPostDraw(struct Game* game);
+
+#endif
@@ -0,0 +1,125 @@
+/*! \file shaders.c
+ *  \brief Shared shaders and their compile times.
+ *
+ *  LoadShader and ReleaseShader keep a reference count per vertex/pixel
+ *  shader pair, so a pair loaded by several users at once gets compiled and
+ *  linked only once. Compile times are logged, so cold and warm starts can
+ *  be compared.
+ *
+ *  Nothing gets kept across runs here: Allegro links the program and looks
+ *  up its uniforms inside al_build_shader, so a binary read back with
+ *  glGetProgramBinary could never be handed to it without linking again.
+ *  Keeping compiled programs around between runs is left to the driver.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+#define MAX_SHADERS 32
+
+struct ShaderCache {
+	struct Game* game;
+	ALLEGRO_MUTEX* mutex; // gamestates get loaded in a background thread
+	struct {
+		char *vertex, *pixel;
+		ALLEGRO_SHADER* shader;
+		int refs;
+	} entries[MAX_SHADERS];
+	double compile_time;
+	int compiled, shared;
+};
+
+struct ShaderCache* CreateShaderCache(struct Game* game) {
+	struct ShaderCache* cache = calloc(1, sizeof(struct ShaderCache));
+	cache->game = game;
+	cache->mutex = al_create_mutex();
+	return cache;
+}
+
+void DestroyShaderCache(struct ShaderCache* cache) {
+	PrintConsole(cache->game, "Shaders: %d compiled in %.1f ms, %d loads shared", cache->compiled, cache->compile_time * 1000.0, cache->shared);
+	for (int i = 0; i < MAX_SHADERS; i++) {
+		if (cache->entries[i].shader) {
+			PrintConsole(cache->game, "Shaders: %s + %s still in use, destroying anyway", cache->entries[i].vertex, cache->entries[i].pixel);
+			DestroyShader(cache->game, cache->entries[i].shader);
+			free(cache->entries[i].vertex);
+			free(cache->entries[i].pixel);
+		}
+	}
+	al_destroy_mutex(cache->mutex);
+	free(cache);
+}
+
+ALLEGRO_SHADER* LoadShader(struct Game* game, const char* vertex, const char* pixel) {
+	struct ShaderCache* cache = game->data->shaders;
+	ALLEGRO_SHADER* shader = NULL;
+	al_lock_mutex(cache->mutex);
+	int slot = -1;
+	for (int i = 0; i < MAX_SHADERS; i++) {
+		if (cache->entries[i].shader && strcmp(cache->entries[i].vertex, vertex) == 0 && strcmp(cache->entries[i].pixel, pixel) == 0) {
+			cache->entries[i].refs++;
+			cache->shared++;
+			shader = cache->entries[i].shader;
+			break;
+		}
+		if (!cache->entries[i].shader && slot < 0) {
+			slot = i;
+		}
+	}
+
+	if (!shader) {
+		double start = al_get_time();
+		shader = CreateShader(game, vertex, pixel);
+		double time = al_get_time() - start;
+		cache->compile_time += time;
+		cache->compiled++;
+		PrintConsole(game, "Shaders: %s + %s compiled in %.1f ms", vertex, pixel, time * 1000.0);
+		if (shader && slot >= 0) {
+			cache->entries[slot].vertex = strdup(vertex);
+			cache->entries[slot].pixel = strdup(pixel);
+			cache->entries[slot].shader = shader;
+			cache->entries[slot].refs = 1;
+		}
+	}
+	al_unlock_mutex(cache->mutex);
+	return shader;
+}
+
+void ReleaseShader(struct Game* game, ALLEGRO_SHADER* shader) {
+	if (!shader) {
+		return;
+	}
+	struct ShaderCache* cache = game->data->shaders;
+	al_lock_mutex(cache->mutex);
+	for (int i = 0; i < MAX_SHADERS; i++) {
+		if (cache->entries[i].shader == shader) {
+			if (--cache->entries[i].refs == 0) {
+				DestroyShader(game, shader);
+				free(cache->entries[i].vertex);
+				free(cache->entries[i].pixel);
+				cache->entries[i].shader = NULL;
+			}
+			al_unlock_mutex(cache->mutex);
+			return;
+		}
+	}
+	al_unlock_mutex(cache->mutex);
+	// didn't fit in the cache
+	DestroyShader(game, shader);
+}
@@ -0,0 +1,331 @@
+/*! \file sounds.c
+ *  \brief Sound effect voice pool.
+ *
+ *  Playing a sound effect only claims a source slot, which keeps track of
+ *  the playback position on its own. The actual mixing happens on a small,
+ *  fixed set of sample instances created up front ([Audio] voices), which
+ *  get handed to the most important sources every frame: higher priority
+ *  first, then the loudest after distance attenuation. Sources that don't get
+ *  a voice (or can't be heard at all) stay virtual and keep advancing, so they
+ *  resume at the right spot once they win a voice back.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sounds.h"
+#include <libsuperderpy.h>
+
+#define MAX_VOICES 64
+#define INAUDIBLE 0.001
+#define HYSTERESIS 1.25 // a mixed sound keeps its voice until something this much louder wants it
+
+struct Source {
+	ALLEGRO_SAMPLE* sample;
+	struct SoundParams params;
+	uint16_t generation; // bumped whenever the slot gets reused, so stale handles don't match
+	bool active;
+	int voice; // -1 when virtual
+	double position; // in sample frames
+	unsigned length, frequency;
+	float audibility, pan, score;
+};
+
+struct SoundPool {
+	struct Game* game;
+	ALLEGRO_MIXER* mixer;
+	ALLEGRO_SAMPLE_INSTANCE* voices[MAX_VOICES];
+	int owners[MAX_VOICES]; // source index or -1
+	int voice_count;
+
+	struct Source sources[SOUND_MAX_SOURCES];
+	int order[SOUND_MAX_SOURCES]; // by score; kept between updates, so it's almost sorted already
+
+	double listener_x, listener_y, range;
+	int stolen, dropped;
+};
+
+struct SoundPool* CreateSoundPool(struct Game* game, ALLEGRO_MIXER* mixer, int voices) {
+	struct SoundPool* pool = calloc(1, sizeof(struct SoundPool));
+	pool->game = game;
+	pool->mixer = mixer;
+	pool->voice_count = fmax(1, fmin(voices, MAX_VOICES));
+	for (int i = 0; i < pool->voice_count; i++) {
+		// attached to the mixer once they get their first sample
+		pool->voices[i] = al_create_sample_instance(NULL);
+		pool->owners[i] = -1;
+	}
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		pool->sources[i].voice = -1;
+		pool->sources[i].generation = 1;
+		pool->order[i] = i;
+	}
+	pool->listener_x = 0.5;
+	pool->listener_y = 0.5;
+	pool->range = 1.0;
+	return pool;
+}
+
+void DestroySoundPool(struct SoundPool* pool) {
+	if (pool->stolen || pool->dropped) {
+		PrintConsole(pool->game, "Sounds: %d voices stolen, %d sounds dropped", pool->stolen, pool->dropped);
+	}
+	for (int i = 0; i < pool->voice_count; i++) {
+		al_destroy_sample_instance(pool->voices[i]);
+	}
+	free(pool);
+}
+
+static void UpdateAudibility(struct SoundPool* pool, struct Source* src) {
+	src->audibility = src->params.gain;
+	src->pan = ALLEGRO_AUDIO_PAN_NONE;
+	if (src->params.positional) {
+		double dx = src->params.x - pool->listener_x, dy = src->params.y - pool->listener_y;
+		double attenuation = fmax(0, 1 - hypot(dx, dy) / pool->range);
+		src->audibility *= attenuation * attenuation;
+		src->pan = fmax(-1, fmin(1, dx * 2 / pool->range));
+	}
+}
+
+static float GetScore(struct Source* src) {
+	if (!src->active) {
+		return -2000;
+	}
+	if (src->audibility <= INAUDIBLE) {
+		// below every audible sound, whatever its priority, so a far away sweep can't keep a voice from a nearby hum
+		return src->params.priority - 1000.0;
+	}
+	return src->params.priority * 1000.0 + src->audibility * ((src->voice >= 0) ? HYSTERESIS : 1.0);
+}
+
+static void ApplyVoiceParams(struct Source* src, ALLEGRO_SAMPLE_INSTANCE* instance) {
+	al_set_sample_instance_gain(instance, src->audibility);
+	al_set_sample_instance_pan(instance, src->pan);
+	al_set_sample_instance_speed(instance, src->params.speed);
+}
+
+static void StartVoice(struct SoundPool* pool, int index, int voice) {
+	struct Source* src = &pool->sources[index];
+	ALLEGRO_SAMPLE_INSTANCE* instance = pool->voices[voice];
+	al_set_sample(instance, src->sample);
+	if (!al_get_sample_instance_attached(instance)) {
+		al_attach_sample_instance_to_mixer(instance, pool->mixer);
+	}
+	al_set_sample_instance_playmode(instance, src->params.loop ? ALLEGRO_PLAYMODE_LOOP : ALLEGRO_PLAYMODE_ONCE);
+	al_set_sample_instance_position(instance, src->position);
+	ApplyVoiceParams(src, instance);
+	al_set_sample_instance_playing(instance, true);
+	pool->owners[voice] = index;
+	src->voice = voice;
+}
+
+static void StopVoice(struct SoundPool* pool, int index) {
+	// Turns the source virtual, remembering where the voice left off.
+	struct Source* src = &pool->sources[index];
+	if (src->voice < 0) {
+		return;
+	}
+	ALLEGRO_SAMPLE_INSTANCE* instance = pool->voices[src->voice];
+	src->position = al_get_sample_instance_position(instance);
+	al_set_sample_instance_playing(instance, false);
+	pool->owners[src->voice] = -1;
+	src->voice = -1;
+}
+
+static int FindFreeVoice(struct SoundPool* pool) {
+	for (int i = 0; i < pool->voice_count; i++) {
+		if (pool->owners[i] < 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void ReleaseSource(struct SoundPool* pool, int index) {
+	StopVoice(pool, index);
+	pool->sources[index].active = false;
+}
+
+static struct Source* GetSource(struct SoundPool* pool, SoundHandle handle) {
+	unsigned index = handle & 0xffff;
+	if (handle == SOUND_NONE || index >= SOUND_MAX_SOURCES) {
+		return NULL;
+	}
+	struct Source* src = &pool->sources[index];
+	if (!src->active || src->generation != handle >> 16) {
+		return NULL;
+	}
+	return src;
+}
+
+SoundHandle PlaySoundEffect(struct SoundPool* pool, ALLEGRO_SAMPLE* sample, struct SoundParams params) {
+	if (!sample) {
+		return SOUND_NONE;
+	}
+	struct Source candidate = {.sample = sample, .params = params, .active = true, .voice = -1};
+	UpdateAudibility(pool, &candidate);
+	float score = GetScore(&candidate);
+
+	int index = -1;
+	float lowest = score;
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		if (!pool->sources[i].active) {
+			index = i;
+			break;
+		}
+		float other = GetScore(&pool->sources[i]);
+		if (other < lowest) {
+			lowest = other;
+			index = i;
+		}
+	}
+	if (index < 0) {
+		pool->dropped++;
+		return SOUND_NONE;
+	}
+	if (pool->sources[index].active) {
+		ReleaseSource(pool, index);
+		pool->dropped++;
+	}
+
+	struct Source* src = &pool->sources[index];
+	uint16_t next = src->generation + 1; // 0 would make the handle look like SOUND_NONE
+	candidate.generation = next ? next : 1;
+	candidate.length = al_get_sample_length(sample);
+	candidate.frequency = al_get_sample_frequency(sample);
+	*src = candidate;
+
+	// take a free voice right away, so the sound doesn't wait for the next update
+	if (src->audibility > INAUDIBLE) {
+		int voice = FindFreeVoice(pool);
+		if (voice >= 0) {
+			StartVoice(pool, index, voice);
+		}
+	}
+	return ((SoundHandle)src->generation << 16) | index;
+}
+
+void StopSoundEffect(struct SoundPool* pool, SoundHandle handle) {
+	struct Source* src = GetSource(pool, handle);
+	if (src) {
+		ReleaseSource(pool, src - pool->sources);
+	}
+}
+
+void StopSampleEffects(struct SoundPool* pool, ALLEGRO_SAMPLE* sample) {
+	// Has to be called before destroying a sample that may still be playing.
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		if (pool->sources[i].active && pool->sources[i].sample == sample) {
+			ReleaseSource(pool, i);
+		}
+	}
+}
+
+bool IsSoundEffectPlaying(struct SoundPool* pool, SoundHandle handle) {
+	return GetSource(pool, handle) != NULL;
+}
+
+void MoveSoundEffect(struct SoundPool* pool, SoundHandle handle, double x, double y) {
+	struct Source* src = GetSource(pool, handle);
+	if (src) {
+		src->params.x = x;
+		src->params.y = y;
+	}
+}
+
+void SetSoundListener(struct SoundPool* pool, double x, double y, double range) {
+	pool->listener_x = x;
+	pool->listener_y = y;
+	pool->range = range;
+}
+
+void UpdateSoundPool(struct SoundPool* pool, double delta) {
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		struct Source* src = &pool->sources[i];
+		if (!src->active) {
+			continue;
+		}
+		if (src->voice >= 0) {
+			ALLEGRO_SAMPLE_INSTANCE* instance = pool->voices[src->voice];
+			if (!al_get_sample_instance_playing(instance)) {
+				ReleaseSource(pool, i);
+				continue;
+			}
+			src->position = al_get_sample_instance_position(instance);
+		} else {
+			src->position += delta * src->params.speed * src->frequency;
+			if (src->position >= src->length) {
+				if (!src->params.loop || !src->length) {
+					src->active = false;
+					continue;
+				}
+				src->position = fmod(src->position, src->length);
+			}
+		}
+		UpdateAudibility(pool, src);
+	}
+
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		pool->sources[i].score = GetScore(&pool->sources[i]);
+	}
+	for (int i = 1; i < SOUND_MAX_SOURCES; i++) {
+		int index = pool->order[i];
+		float score = pool->sources[index].score;
+		int j = i;
+		while (j > 0 && pool->sources[pool->order[j - 1]].score < score) {
+			pool->order[j] = pool->order[j - 1];
+			j--;
+		}
+		pool->order[j] = index;
+	}
+
+	// first take the voices away from everything that didn't make the cut...
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		struct Source* src = &pool->sources[pool->order[i]];
+		bool wanted = i < pool->voice_count && src->active && src->audibility > INAUDIBLE;
+		if (!wanted && src->voice >= 0) {
+			if (src->audibility > INAUDIBLE) {
+				pool->stolen++;
+			}
+			StopVoice(pool, pool->order[i]);
+		}
+	}
+	// ...then hand them over to the ones that did
+	for (int i = 0; i < pool->voice_count; i++) {
+		struct Source* src = &pool->sources[pool->order[i]];
+		if (!src->active || src->audibility <= INAUDIBLE) {
+			break;
+		}
+		if (src->voice >= 0) {
+			ApplyVoiceParams(src, pool->voices[src->voice]);
+		} else {
+			StartVoice(pool, pool->order[i], FindFreeVoice(pool));
+		}
+	}
+}
+
+struct SoundPoolStats GetSoundPoolStats(struct SoundPool* pool) {
+	struct SoundPoolStats stats = {.stolen = pool->stolen, .dropped = pool->dropped};
+	for (int i = 0; i < SOUND_MAX_SOURCES; i++) {
+		if (pool->sources[i].active) {
+			stats.sources++;
+			if (pool->sources[i].voice >= 0) {
+				stats.mixed++;
+			}
+		}
+	}
+	return stats;
+}
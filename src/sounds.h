@@ -0,0 +1,65 @@
+/*! \file sounds.h
+ *  \brief Sound effect voice pool.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_SOUNDS_H
+#define SECRETSANTA_SOUNDS_H
+
+#include <libsuperderpy.h>
+
+#define SOUND_MAX_SOURCES 512
+#define SOUND_NONE 0
+
+typedef uint32_t SoundHandle;
+
+enum SoundPriority {
+	SOUND_PRIORITY_AMBIENT,
+	SOUND_PRIORITY_NORMAL,
+	SOUND_PRIORITY_UI
+};
+
+struct SoundParams {
+	float gain, speed;
+	enum SoundPriority priority; // higher priority sounds always win the voices over lower ones
+	bool loop;
+	bool positional; // attenuated and panned by the distance from the listener
+	double x, y;
+};
+
+#define SOUND_PARAMS(...) ((struct SoundParams){.gain = 1.0, .speed = 1.0, .priority = SOUND_PRIORITY_NORMAL, __VA_ARGS__})
+
+struct SoundPoolStats {
+	int sources; // sounds currently playing, audible or not
+	int mixed; // of those, sounds that have a voice
+	int stolen; // voices taken away from a less important sound since the pool was created
+	int dropped; // sounds that couldn't even get a source
+};
+
+struct SoundPool* CreateSoundPool(struct Game* game, ALLEGRO_MIXER* mixer, int voices);
+void DestroySoundPool(struct SoundPool* pool);
+SoundHandle PlaySoundEffect(struct SoundPool* pool, ALLEGRO_SAMPLE* sample, struct SoundParams params);
+void StopSoundEffect(struct SoundPool* pool, SoundHandle handle);
+void StopSampleEffects(struct SoundPool* pool, ALLEGRO_SAMPLE* sample);
+bool IsSoundEffectPlaying(struct SoundPool* pool, SoundHandle handle);
+void MoveSoundEffect(struct SoundPool* pool, SoundHandle handle, double x, double y);
+void SetSoundListener(struct SoundPool* pool, double x, double y, double range);
+void UpdateSoundPool(struct SoundPool* pool, double delta);
+struct SoundPoolStats GetSoundPoolStats(struct SoundPool* pool);
+
+#endif
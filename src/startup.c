@@ -0,0 +1,202 @@
+/*! \file startup.c
+ *  \brief Startup time benchmark.
+ *
+ *  Only compiled in with -DSTARTUP_BENCHMARK=ON. With --bench-startup[=FILE],
+ *  the time spent in every phase of the startup gets written to FILE (by
+ *  default startup.json): getting to main(), Allegro and libsuperderpy
+ *  initialization, each loading step of both gamestates, the game's PostLoad
+ *  and finally the first frame presented by the game, after which it quits.
+ *  The intro gets loaded as well, but not played.
+ *
+ *  Time until main() is measured against SECRETSANTA_LAUNCH_TIME (wall clock
+ *  seconds, as set by tools/bench-startup.sh right before launching) when
+ *  available, and against the start time kept by the kernel otherwise, which
+ *  is only accurate to a clock tick.
+ *
+ *  A single run is noisy and can't be cold on its own, so repeated cold and
+ *  warm runs, their medians and the comparison against a baseline are left
+ *  to tools/bench-startup.sh.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef STARTUP_BENCHMARK
+
+#include "startup.h"
+#include <libsuperderpy.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PHASES 64
+
+static struct {
+	bool enabled;
+	const char* output;
+	double last;
+	struct {
+		char name[48];
+		double duration;
+	} phases[MAX_PHASES];
+	atomic_int count; // loading steps get marked from the loading thread
+
+	const char* gamestate;
+	int step;
+	ProgressFunc* progress;
+
+	bool armed, drawn, done;
+} startup;
+
+static double Now(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static double GetPreMainTime(void) {
+	const char* launch = getenv("SECRETSANTA_LAUNCH_TIME");
+	if (launch) {
+		return Now(CLOCK_REALTIME) - strtod(launch, NULL);
+	}
+	FILE* stat = fopen("/proc/self/stat", "r");
+	if (!stat) {
+		return 0;
+	}
+	char buffer[1024];
+	size_t len = fread(buffer, 1, sizeof(buffer) - 1, stat);
+	fclose(stat);
+	buffer[len] = '\0';
+	// the process name may contain spaces, so the fields get counted from its closing parenthesis
+	const char* fields = strrchr(buffer, ')');
+	unsigned long long start;
+	if (!fields || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &start) != 1) {
+		return 0;
+	}
+	return Now(CLOCK_BOOTTIME) - start / (double)sysconf(_SC_CLK_TCK);
+}
+
+static void AddPhase(const char* name, double duration) {
+	int i = atomic_fetch_add(&startup.count, 1);
+	if (i >= MAX_PHASES) {
+		return;
+	}
+	snprintf(startup.phases[i].name, sizeof(startup.phases[i].name), "%s", name);
+	startup.phases[i].duration = duration;
+}
+
+void InitStartupBenchmark(const char* output) {
+	// Has to be called first thing in main().
+	startup.enabled = true;
+	startup.output = output;
+	startup.last = Now(CLOCK_MONOTONIC);
+	AddPhase("process start", GetPreMainTime());
+}
+
+bool IsStartupBenchmarkEnabled(void) {
+	return startup.enabled;
+}
+
+void MarkStartupPhase(const char* name) {
+	// Ends the current phase, giving it a name.
+	if (!startup.enabled || startup.done) {
+		return;
+	}
+	double now = Now(CLOCK_MONOTONIC);
+	AddPhase(name, now - startup.last);
+	startup.last = now;
+}
+
+static void TimedProgress(struct Game* game) {
+	char name[48];
+	snprintf(name, sizeof(name), "%s: load step %d", startup.gamestate, ++startup.step);
+	MarkStartupPhase(name);
+	startup.progress(game);
+}
+
+ProgressFunc* TimeLoadingSteps(const char* gamestate, ProgressFunc* progress) {
+	// Gamestates get loaded one after another, so a single wrapper at a time is enough.
+	if (!startup.enabled) {
+		return progress;
+	}
+	startup.gamestate = gamestate;
+	startup.step = 0;
+	startup.progress = progress;
+	return TimedProgress;
+}
+
+void StartupGamestateStarted(const char* gamestate) {
+	char name[48];
+	snprintf(name, sizeof(name), "%s: start", gamestate);
+	MarkStartupPhase(name);
+	startup.armed = true;
+}
+
+void StartupBenchmarkPreLogic(struct Game* game) {
+	// The frame drawn in the previous iteration has been flipped by now.
+	if (startup.drawn && !startup.done) {
+		MarkStartupPhase("first frame");
+		startup.done = true;
+	}
+}
+
+bool StartupBenchmarkPostDraw(struct Game* game) {
+	// Returns true once the first frame has been presented.
+	if (startup.armed) {
+		startup.drawn = true;
+	}
+	return startup.done;
+}
+
+int FinishStartupBenchmark(void) {
+	// Returns non-zero when the startup didn't get to the first frame.
+	if (!startup.enabled) {
+		return 0;
+	}
+	startup.enabled = false;
+	int count = atomic_load(&startup.count);
+	if (count > MAX_PHASES) {
+		count = MAX_PHASES;
+	}
+
+	double total = 0;
+	printf("Startup benchmark\n");
+	for (int i = 0; i < count; i++) {
+		total += startup.phases[i].duration;
+		printf("%-28s %9.2f ms\n", startup.phases[i].name, startup.phases[i].duration * 1000.0);
+	}
+	printf("%-28s %9.2f ms\n", "total", total * 1000.0);
+
+	FILE* file = fopen(startup.output, "w");
+	if (!file) {
+		fprintf(stderr, "Startup benchmark FAILED: could not write %s\n", startup.output);
+		return 1;
+	}
+	fprintf(file, "{\n\t\"phases\": [\n");
+	for (int i = 0; i < count; i++) {
+		fprintf(file, "\t\t{\"name\": \"%s\", \"ms\": %.3f}%s\n", startup.phases[i].name, startup.phases[i].duration * 1000.0, (i < count - 1) ? "," : "");
+	}
+	fprintf(file, "\t],\n\t\"total_ms\": %.3f,\n\t\"complete\": %s\n}\n", total * 1000.0, startup.done ? "true" : "false");
+	fclose(file);
+
+	if (!startup.done) {
+		fprintf(stderr, "Startup benchmark FAILED: quit before the first frame\n");
+		return 1;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*! \file startup.h
+ *  \brief Startup time benchmark.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_STARTUP_H
+#define SECRETSANTA_STARTUP_H
+
+#include <libsuperderpy.h>
+
+typedef void ProgressFunc(struct Game* game);
+
+#ifdef STARTUP_BENCHMARK
+
+void InitStartupBenchmark(const char* output);
+bool IsStartupBenchmarkEnabled(void);
+void MarkStartupPhase(const char* name);
+ProgressFunc* TimeLoadingSteps(const char* gamestate, ProgressFunc* progress);
+void StartupGamestateStarted(const char* gamestate);
+void StartupBenchmarkPreLogic(struct Game* game);
+bool StartupBenchmarkPostDraw(struct Game* game);
+int FinishStartupBenchmark(void);
+
+#else
+
+static inline void InitStartupBenchmark(const char* output) {}
+static inline bool IsStartupBenchmarkEnabled(void) { return false; }
+static inline void MarkStartupPhase(const char* name) {}
+static inline ProgressFunc* TimeLoadingSteps(const char* gamestate, ProgressFunc* progress) { return progress; }
+static inline void StartupGamestateStarted(const char* gamestate) {}
+static inline void StartupBenchmarkPreLogic(struct Game* game) {}
+static inline bool StartupBenchmarkPostDraw(struct Game* game) { return false; }
+static inline int FinishStartupBenchmark(void) { return 0; }
+
+#endif
+
+#endif
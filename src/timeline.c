@@ -0,0 +1,222 @@
+/*! \file timeline.c
+ *  \brief Fixed-capacity timeline of actions.
+ *
+ *  A stand-in for libsuperderpy's timeline manager for screens that know up
+ *  front how many actions they'll queue. The timeline manager allocates every
+ *  action, its arguments and, for queued background actions, a second action
+ *  once the first one gets to run, so a scripted sequence keeps allocating
+ *  while it plays. Here all the actions and their arguments live in slots
+ *  allocated together with the timeline; actions added when every slot is
+ *  taken are dropped with a warning instead.
+ *
+ *  The actions are ordinary TM_ACTION callbacks and see the same states as
+ *  they would under the timeline manager. Each timeline counts the heap
+ *  allocations made while it plays (in -DALLOC_TRACKING=ON builds) and reports
+ *  them along with the number of dropped actions when it gets destroyed.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timeline.h"
+#include "alloctrack.h"
+#include <libsuperderpy.h>
+#include <stdarg.h>
+
+enum EntryKind {
+	ENTRY_DELAY,
+	ENTRY_ACTION,
+	ENTRY_BACKGROUND
+};
+
+struct Entry {
+	enum EntryKind kind;
+	FixedTimelineAction callback;
+	struct TM_Action action;
+	struct TM_Arguments args[TIMELINE_MAX_ARGS];
+	char name[32];
+	double delay;
+	bool started, running, finished;
+};
+
+struct FixedTimeline {
+	struct Game* game;
+	struct GamestateResources* data;
+	char name[32];
+	int capacity, count, head;
+	int dropped;
+	long allocations;
+	struct Entry entries[];
+};
+
+struct FixedTimeline* CreateFixedTimeline(struct Game* game, struct GamestateResources* data, const char* name, int capacity) {
+	struct FixedTimeline* timeline = calloc(1, sizeof(struct FixedTimeline) + sizeof(struct Entry) * capacity);
+	timeline->game = game;
+	timeline->data = data;
+	timeline->capacity = capacity;
+	snprintf(timeline->name, sizeof(timeline->name), "%s", name);
+	return timeline;
+}
+
+static struct Entry* AddEntry(struct FixedTimeline* timeline, enum EntryKind kind, const char* name) {
+	if (timeline->head == timeline->count) {
+		// everything queued so far is done; reuse the slots unless something still runs in background
+		bool busy = false;
+		for (int i = 0; i < timeline->count; i++) {
+			busy |= timeline->entries[i].running;
+		}
+		if (!busy) {
+			timeline->count = timeline->head = 0;
+		}
+	}
+	if (timeline->count == timeline->capacity) {
+		PrintConsole(timeline->game, "Timeline %s: all %d slots taken, dropping %s!", timeline->name, timeline->capacity, name ? name : "an action");
+		timeline->dropped++;
+		return NULL;
+	}
+	struct Entry* entry = &timeline->entries[timeline->count++];
+	*entry = (struct Entry){.kind = kind};
+	snprintf(entry->name, sizeof(entry->name), "%s", name ? name : "");
+	return entry;
+}
+
+static void SetArguments(struct Entry* entry, int argc, va_list args) {
+	if (argc > TIMELINE_MAX_ARGS) {
+		argc = TIMELINE_MAX_ARGS;
+	}
+	for (int i = 0; i < argc; i++) {
+		entry->args[i].value = va_arg(args, void*);
+		entry->args[i].next = (i + 1 < argc) ? &entry->args[i + 1] : NULL;
+	}
+	entry->action.arguments = argc ? entry->args : NULL;
+	entry->action.name = entry->name;
+	entry->action.state = TM_ACTIONSTATE_INIT;
+}
+
+bool AddFixedDelay(struct FixedTimeline* timeline, double delay) {
+	struct Entry* entry = AddEntry(timeline, ENTRY_DELAY, "delay");
+	if (!entry) {
+		return false;
+	}
+	entry->delay = delay;
+	return true;
+}
+
+bool AddFixedAction(struct FixedTimeline* timeline, FixedTimelineAction callback, const char* name, int argc, ...) {
+	struct Entry* entry = AddEntry(timeline, ENTRY_ACTION, name);
+	if (!entry) {
+		return false;
+	}
+	entry->callback = callback;
+	va_list args;
+	va_start(args, argc);
+	SetArguments(entry, argc, args);
+	va_end(args);
+	return true;
+}
+
+bool AddFixedBackgroundAction(struct FixedTimeline* timeline, FixedTimelineAction callback, const char* name, double delay, int argc, ...) {
+	// starts running in background once it gets to the front of the queue, after the given delay
+	struct Entry* entry = AddEntry(timeline, ENTRY_BACKGROUND, name);
+	if (!entry) {
+		return false;
+	}
+	entry->callback = callback;
+	entry->delay = delay;
+	va_list args;
+	va_start(args, argc);
+	SetArguments(entry, argc, args);
+	va_end(args);
+	return true;
+}
+
+static void FinishEntry(struct FixedTimeline* timeline, struct Entry* entry) {
+	entry->action.state = TM_ACTIONSTATE_DESTROY;
+	entry->callback(timeline->game, timeline->data, &entry->action);
+	entry->running = false;
+	entry->finished = true;
+}
+
+static bool RunEntry(struct FixedTimeline* timeline, struct Entry* entry, double delta) {
+	// Returns true when the action is done.
+	if (!entry->started) {
+		entry->started = true;
+		entry->action.state = TM_ACTIONSTATE_START;
+		entry->action.delta = 0;
+		entry->callback(timeline->game, timeline->data, &entry->action);
+	}
+	entry->action.state = TM_ACTIONSTATE_RUNNING;
+	entry->action.delta = delta;
+	if (entry->callback(timeline->game, timeline->data, &entry->action) == TM_REPEAT) {
+		return false;
+	}
+	FinishEntry(timeline, entry);
+	return true;
+}
+
+void ProcessFixedTimeline(struct FixedTimeline* timeline, double delta) {
+	long allocations = GetAllocationCount();
+
+	for (int i = 0; i < timeline->head; i++) {
+		struct Entry* entry = &timeline->entries[i];
+		if (!entry->running) {
+			continue;
+		}
+		if (entry->delay > 0) {
+			entry->delay -= delta;
+			continue;
+		}
+		RunEntry(timeline, entry, delta);
+	}
+
+	while (timeline->head < timeline->count) {
+		struct Entry* entry = &timeline->entries[timeline->head];
+		if (entry->kind == ENTRY_DELAY) {
+			entry->delay -= delta;
+			if (entry->delay > 0) {
+				break;
+			}
+			delta = -entry->delay; // the rest of the frame goes to whatever comes next
+			entry->finished = true;
+		} else if (entry->kind == ENTRY_BACKGROUND) {
+			entry->running = true;
+		} else if (!RunEntry(timeline, entry, delta)) {
+			break;
+		}
+		timeline->head++;
+	}
+
+	timeline->allocations += GetAllocationCount() - allocations;
+}
+
+long GetFixedTimelineAllocations(struct FixedTimeline* timeline) {
+	return timeline->allocations;
+}
+
+void DestroyFixedTimeline(struct FixedTimeline* timeline) {
+	for (int i = 0; i < timeline->count; i++) {
+		struct Entry* entry = &timeline->entries[i];
+		if (entry->kind != ENTRY_DELAY && !entry->finished) {
+			FinishEntry(timeline, entry);
+		}
+	}
+#ifdef ALLOC_TRACKING
+	PrintConsole(timeline->game, "Timeline %s: %ld allocations while playing, %d actions dropped", timeline->name, timeline->allocations, timeline->dropped);
+#else
+	PrintConsole(timeline->game, "Timeline %s: %d actions dropped (build with -DALLOC_TRACKING=ON to count allocations)", timeline->name, timeline->dropped);
+#endif
+	free(timeline);
+}
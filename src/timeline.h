@@ -0,0 +1,40 @@
+/*! \file timeline.h
+ *  \brief Fixed-capacity timeline of actions.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_TIMELINE_H
+#define SECRETSANTA_TIMELINE_H
+
+#include <libsuperderpy.h>
+
+#define TIMELINE_MAX_ARGS 4
+
+typedef TM_ACTION((*FixedTimelineAction));
+
+struct FixedTimeline;
+
+struct FixedTimeline* CreateFixedTimeline(struct Game* game, struct GamestateResources* data, const char* name, int capacity);
+void DestroyFixedTimeline(struct FixedTimeline* timeline);
+void ProcessFixedTimeline(struct FixedTimeline* timeline, double delta);
+bool AddFixedDelay(struct FixedTimeline* timeline, double delay);
+bool AddFixedAction(struct FixedTimeline* timeline, FixedTimelineAction callback, const char* name, int argc, ...);
+bool AddFixedBackgroundAction(struct FixedTimeline* timeline, FixedTimelineAction callback, const char* name, double delay, int argc, ...);
+long GetFixedTimelineAllocations(struct FixedTimeline* timeline);
+
+#endif
@@ -0,0 +1,558 @@
+/*! \file world.c
+ *  \brief Deterministic simulation of the race.
+ *
+ *  Everything that decides the outcome of a race: Santas moving according to
+ *  the inputs of their players, drones sweeping their cones around and the
+ *  collisions between them. The whole state lives in a plain struct World and
+ *  gets advanced in fixed ticks, so the rollback netcode can snapshot it and
+ *  re-simulate it, and both peers arrive at exactly the same result.
+ *
+ *  --bench-netplay fills the drone field and measures how long the netcode
+ *  takes to roll back and re-simulate the number of ticks covered by its
+ *  budget, failing when it takes longer.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world.h"
+#include "jobs.h"
+#include <libsuperderpy.h>
+#include <stddef.h>
+
+#define COLLISION_RESOLUTION 0.01 // max distance a hitbox or cone edge may move between collision checks
+#define PARALLEL_THRESHOLD 32 // entity count above which updates are spread across the job system
+#define PARALLEL_GRAIN 8
+#define BENCHMARK_SEED 0x5eed
+#define BENCHMARK_ITERATIONS 500
+
+static uint32_t RandomInt(uint32_t* state) {
+	// xorshift32, so the whole simulation can be reproduced from a single seed
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static double Random(uint32_t* state) {
+	return RandomInt(state) / (double)UINT32_MAX;
+}
+
+static double TriangleArea(double x1, double y1, double x2, double y2, double x3, double y3) {
+	return fabs((x1 * (y2 - y3) + x2 * (y3 - y1) + x3 * (y1 - y2)) / 2.0);
+}
+
+static bool IsInsideTriangle(double x1, double y1, double x2, double y2, double x3, double y3, double x, double y) {
+	double A = TriangleArea(x1, y1, x2, y2, x3, y3);
+	double A1 = TriangleArea(x, y, x2, y2, x3, y3);
+	double A2 = TriangleArea(x1, y1, x, y, x3, y3);
+	double A3 = TriangleArea(x1, y1, x2, y2, x, y);
+	return fabs(A - (A1 + A2 + A3)) < 0.001;
+}
+
+void GetDroneTriangle(const struct Drone* drone, double* x1, double* y1, double* x2, double* y2, double* x3, double* y3) {
+	double x = drone->x;
+	double y = drone->y + cos(drone->counter * drone->speed) * drone->deviation + 0.02;
+
+	*x1 = x;
+	*y1 = y;
+	*x2 = x + cos(drone->angle + drone->span) * drone->length;
+	*y2 = y + sin(drone->angle + drone->span) * drone->length * 1.777;
+	*x3 = x + cos(drone->angle - drone->span) * drone->length;
+	*y3 = y + sin(drone->angle - drone->span) * drone->length * 1.777;
+}
+
+bool IsSantaInDroneTriangle(const struct Drone* drone, const struct Santa* santa) {
+	// don't judge me
+	double x1, y1, x2, y2, x3, y3;
+	GetDroneTriangle(drone, &x1, &y1, &x2, &y2, &x3, &y3);
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x, santa->y)) return true;
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot - ALLEGRO_PI / 2.0) * 0.02, santa->y + sin(santa->rot - ALLEGRO_PI / 2.0) * 0.02)) return true;
+
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot) * 0.14, santa->y + sin(santa->rot) * 0.14 * 1.7777)) return true;
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + cos(santa->rot) * 0.14, santa->y + sin(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + sin(santa->rot) * 0.14 * 1.7777)) return true;
+
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot) * 0.07, santa->y + sin(santa->rot) * 0.07 * 1.7777)) return true;
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + cos(santa->rot) * 0.07, santa->y + sin(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + sin(santa->rot) * 0.07 * 1.7777)) return true;
+
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot) * 0.035, santa->y + sin(santa->rot) * 0.035 * 1.7777)) return true;
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + cos(santa->rot) * 0.035, santa->y + sin(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + sin(santa->rot) * 0.035 * 1.7777)) return true;
+
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot) * 0.105, santa->y + sin(santa->rot) * 0.105 * 1.7777)) return true;
+	if (IsInsideTriangle(x1, y1, x2, y2, x3, y3, santa->x + cos(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + cos(santa->rot) * 0.105, santa->y + sin(santa->rot - ALLEGRO_PI / 2.0) * 0.02 + sin(santa->rot) * 0.105 * 1.7777)) return true;
+	return false;
+}
+
+static double AngleDifference(double from, double to) {
+	double diff = fmod(to - from, ALLEGRO_PI * 2);
+	if (diff > ALLEGRO_PI) {
+		diff -= ALLEGRO_PI * 2;
+	}
+	if (diff < -ALLEGRO_PI) {
+		diff += ALLEGRO_PI * 2;
+	}
+	return diff;
+}
+
+static double GetSantaMotion(const struct Santa* from, const struct Santa* to) {
+	// upper bound of how far any point of the hitbox has travelled
+	return hypot(to->x - from->x, to->y - from->y) + fabs(AngleDifference(from->rot, to->rot)) * (0.14 * 1.7777 + 0.02);
+}
+
+static double GetDroneMotion(const struct Drone* from, const struct Drone* to) {
+	// upper bound of how far any point of the cone has travelled
+	return fabs(to->counter - from->counter) * to->speed * to->deviation + fabs(to->angle - from->angle) * to->length * 1.777;
+}
+
+static bool IsSantaSweptThroughDrone(const struct Drone* drone_from, const struct Drone* drone_to, const struct Santa* santa_from, const struct Santa* santa_to) {
+	// Checking just the end of the step would let a fast cone or Santa tunnel through each other, so
+	// the whole step gets subdivided finely enough for nothing to move farther than COLLISION_RESOLUTION.
+	double santa_motion = GetSantaMotion(santa_from, santa_to);
+	double drone_motion = GetDroneMotion(drone_from, drone_to);
+
+	// bounding circles around the cone's apex and Santa's origin, grown by the distance travelled
+	double santa_reach = 0.14 * 1.7777 + 0.02 + santa_motion;
+	double drone_reach = drone_to->length * 1.777 + drone_to->deviation + 0.02 + drone_motion;
+	if (hypot(santa_to->x - drone_to->x, santa_to->y - drone_to->y) > santa_reach + drone_reach) {
+		return false;
+	}
+
+	int steps = ceil((santa_motion + drone_motion) / COLLISION_RESOLUTION);
+	if (steps < 1) {
+		steps = 1;
+	}
+	if (steps > 64) {
+		steps = 64;
+	}
+
+	double drot = AngleDifference(santa_from->rot, santa_to->rot);
+	for (int i = 1; i <= steps; i++) {
+		double t = i / (double)steps;
+		struct Santa santa = *santa_to;
+		santa.x = santa_from->x + (santa_to->x - santa_from->x) * t;
+		santa.y = santa_from->y + (santa_to->y - santa_from->y) * t;
+		santa.rot = santa_from->rot + drot * t;
+
+		struct Drone drone = *drone_to;
+		drone.counter = drone_from->counter + (drone_to->counter - drone_from->counter) * t;
+		drone.angle = drone_from->angle + (drone_to->angle - drone_from->angle) * t;
+
+		if (IsSantaInDroneTriangle(&drone, &santa)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void ResetSanta(struct World* world, int player) {
+	struct Santa* santa = &world->santas[player];
+	santa->x = 0.055;
+	santa->y = 0.7 + player * 0.1;
+	santa->rot = -ALLEGRO_PI / 2.0;
+	santa->speed = 0;
+	santa->pause = 0;
+}
+
+void StartLevel(struct World* world, bool retry) {
+	world->pause = 0;
+	for (int p = 0; p < world->players; p++) {
+		ResetSanta(world, p);
+	}
+
+	if (!retry) {
+		for (int i = 0; i < MAX_DRONES; i++) {
+			world->drones[i].enabled = false;
+		}
+	}
+
+	if (world->level == 0) {
+		world->drones[0].enabled = true;
+		world->drones[0].x = 0.5;
+		world->drones[0].y = 0.4;
+		world->drones[0].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[0].angle = -ALLEGRO_PI / 2;
+		world->drones[0].left = 4;
+		world->drones[0].deviation = 0.005;
+		world->drones[0].speed = 4;
+		world->drones[0].rotspeed = 0.333;
+		world->drones[0].timemin = 2;
+		world->drones[0].timemax = 5;
+		world->drones[0].span = 0.33;
+		world->drones[0].length = 0.33;
+	}
+
+	if (world->level == 1) {
+		world->drones[0].enabled = true;
+		world->drones[0].x = 0.42;
+		world->drones[0].y = 0.5;
+		world->drones[0].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[0].angle = -ALLEGRO_PI / 2 * 0.245;
+		world->drones[0].left = 3.5;
+		world->drones[0].deviation = 0.007;
+		world->drones[0].speed = 3.7;
+		world->drones[0].rotspeed = 0.4;
+		world->drones[0].timemin = 3;
+		world->drones[0].timemax = 6;
+		world->drones[0].span = 0.23;
+		world->drones[0].length = 0.33;
+
+		world->drones[1].enabled = true;
+		world->drones[1].x = 0.7;
+		world->drones[1].y = 0.3;
+		world->drones[1].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[1].angle = -ALLEGRO_PI / 2;
+		world->drones[1].left = 4;
+		world->drones[1].deviation = 0.005;
+		world->drones[1].speed = 4;
+		world->drones[1].rotspeed = 0.333;
+		world->drones[1].timemin = 2;
+		world->drones[1].timemax = 5;
+		world->drones[1].span = 0.33;
+		world->drones[1].length = 0.23;
+	}
+
+	if (world->level == 2) {
+		world->drones[0].enabled = true;
+		world->drones[0].x = 0.4;
+		world->drones[0].y = 0.3;
+		world->drones[0].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[0].angle = -ALLEGRO_PI / 2 * 0.245;
+		world->drones[0].left = 3.5;
+		world->drones[0].deviation = 0.007;
+		world->drones[0].speed = 3.7;
+		world->drones[0].rotspeed = 0.4;
+		world->drones[0].timemin = 3;
+		world->drones[0].timemax = 6;
+		world->drones[0].span = 0.33;
+		world->drones[0].length = 0.33;
+
+		world->drones[1].enabled = true;
+		world->drones[1].x = 0.55;
+		world->drones[1].y = 0.6;
+		world->drones[1].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[1].angle = -ALLEGRO_PI / 2;
+		world->drones[1].left = 4;
+		world->drones[1].deviation = 0.005;
+		world->drones[1].speed = 4;
+		world->drones[1].rotspeed = 0.333;
+		world->drones[1].timemin = 2;
+		world->drones[1].timemax = 5;
+		world->drones[1].span = 0.33;
+		world->drones[1].length = 0.33;
+
+		world->drones[2].enabled = true;
+		world->drones[2].x = 0.75;
+		world->drones[2].y = 0.5;
+		world->drones[2].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[2].angle = -ALLEGRO_PI / 2 * RandomInt(&world->rng);
+		world->drones[2].left = 1;
+		world->drones[2].deviation = 0.005;
+		world->drones[2].speed = 4;
+		world->drones[2].rotspeed = 0.5;
+		world->drones[2].timemin = 1;
+		world->drones[2].timemax = 3;
+		world->drones[2].span = 0.33;
+		world->drones[2].length = 0.33;
+	}
+
+	if (world->level == 3) {
+		world->drones[0].enabled = true;
+		world->drones[0].x = 0.41;
+		world->drones[0].y = 0.6;
+		world->drones[0].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[0].angle = -ALLEGRO_PI / 2 * 0.245;
+		world->drones[0].left = 3.5;
+		world->drones[0].deviation = 0.007;
+		world->drones[0].speed = 3.7;
+		world->drones[0].rotspeed = 0.4;
+		world->drones[0].timemin = 3;
+		world->drones[0].timemax = 6;
+		world->drones[0].span = 0.23;
+		world->drones[0].length = 0.23;
+
+		world->drones[1].enabled = true;
+		world->drones[1].x = 0.5;
+		world->drones[1].y = 0.3;
+		world->drones[1].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[1].angle = -ALLEGRO_PI / 2;
+		world->drones[1].left = 4;
+		world->drones[1].deviation = 0.005;
+		world->drones[1].speed = 4;
+		world->drones[1].rotspeed = 0.333;
+		world->drones[1].timemin = 2;
+		world->drones[1].timemax = 5;
+		world->drones[1].span = 0.13;
+		world->drones[1].length = 0.35;
+
+		world->drones[2].enabled = true;
+		world->drones[2].x = 0.7;
+		world->drones[2].y = 0.55;
+		world->drones[2].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[2].angle = -ALLEGRO_PI / 2 * RandomInt(&world->rng);
+		world->drones[2].left = 1;
+		world->drones[2].deviation = 0.005;
+		world->drones[2].speed = 4;
+		world->drones[2].rotspeed = 0.5;
+		world->drones[2].timemin = 1;
+		world->drones[2].timemax = 3;
+		world->drones[2].span = 0.33;
+		world->drones[2].length = 0.33;
+
+		world->drones[3].enabled = true;
+		world->drones[3].x = 0.66;
+		world->drones[3].y = 0.5;
+		world->drones[3].counter = Random(&world->rng) * ALLEGRO_PI;
+		world->drones[3].angle = -ALLEGRO_PI / 2 * RandomInt(&world->rng);
+		world->drones[3].left = 1;
+		world->drones[3].deviation = 0.2;
+		world->drones[3].speed = 0.5;
+		world->drones[3].rotspeed = 0.2;
+		world->drones[3].timemin = 1;
+		world->drones[3].timemax = 3;
+		world->drones[3].span = 0.45;
+		world->drones[3].length = 0.1;
+	}
+
+	if (world->level > 3 && !retry) {
+		for (int i = 0; i < fmin(world->level, MAX_DRONES); i++) {
+			world->drones[i].enabled = true;
+			world->drones[i].x = 0.4 + Random(&world->rng) * 0.4;
+			world->drones[i].y = 0.1 + Random(&world->rng) * 0.8;
+			world->drones[i].counter = Random(&world->rng) * ALLEGRO_PI;
+			world->drones[i].angle = RandomInt(&world->rng);
+			world->drones[i].left = Random(&world->rng) * 5;
+			world->drones[i].deviation = Random(&world->rng) * 0.05;
+			world->drones[i].speed = 1 + Random(&world->rng) * 3;
+			world->drones[i].rotspeed = 0.1 + Random(&world->rng) * 0.4;
+			world->drones[i].timemin = 1 + Random(&world->rng) * 4;
+			world->drones[i].timemax = world->drones[i].timemin + Random(&world->rng) * 4;
+			world->drones[i].span = 0.1 + Random(&world->rng) * 0.23;
+			world->drones[i].length = 0.1 + Random(&world->rng) * 0.23;
+		}
+	}
+	if (world->level > 3 && retry) {
+		for (int i = 0; i < fmin(world->level, MAX_DRONES); i++) {
+			world->drones[i].counter = Random(&world->rng) * ALLEGRO_PI;
+			world->drones[i].angle = RandomInt(&world->rng);
+		}
+	}
+
+	world->drone_count = 0;
+	for (int i = 0; i < MAX_DRONES; i++) {
+		if (world->drones[i].enabled) {
+			world->drones[i].rng = RandomInt(&world->rng) | 1;
+			world->drone_count = i + 1;
+		}
+	}
+}
+
+void InitWorld(struct World* world, uint32_t seed, int players, int tick_rate) {
+	memset(world, 0, sizeof(struct World));
+	world->rng = seed ? seed : 0x5eed;
+	world->players = players;
+	world->delta = 1.0 / tick_rate;
+	StartLevel(world, false);
+}
+
+static void MoveSanta(struct Santa* santa, const struct PlayerInput* input, double delta) {
+	// the original constants were tuned per 60 Hz tick
+	double ticks = delta * DEFAULT_TICK_RATE;
+
+	double dspeed = 0;
+	dspeed += 0.03 * input->accelerate / INPUT_HELD_MAX;
+	dspeed += ((santa->speed > 0) ? -0.02 : -0.01) * input->brake / INPUT_HELD_MAX;
+	santa->speed = fmin(1, fmax(-0.5, santa->speed + dspeed * ticks));
+
+	santa->speed *= pow(0.975, ticks);
+
+	santa->x += cos(santa->rot) * santa->speed * 0.005 * ticks;
+	santa->y += sin(santa->rot) * santa->speed * 0.005 * ticks;
+
+	double dangle = 0;
+	dangle += -0.025 * input->left / INPUT_HELD_MAX;
+	dangle += 0.025 * input->right / INPUT_HELD_MAX;
+	santa->rot += dangle * ticks;
+	if (santa->rot > ALLEGRO_PI * 2) {
+		santa->rot -= ALLEGRO_PI * 2;
+	}
+	if (santa->rot < 0) {
+		santa->rot += ALLEGRO_PI * 2;
+	}
+
+	santa->x = fmax(0, fmin(santa->x, 1));
+	santa->y = fmax(0, fmin(santa->y, 1));
+}
+
+static void MoveDrone(struct Drone* drone, double delta) {
+	drone->counter += delta;
+	if (drone->left > 0) {
+		drone->left -= delta;
+		drone->angle -= delta * drone->rotspeed;
+		if (drone->left <= 0) {
+			drone->left = (Random(&drone->rng) * (drone->timemax - drone->timemin) + drone->timemin) * ((RandomInt(&drone->rng) % 2) ? 1 : -1);
+		}
+	} else if (drone->left < 0) {
+		drone->left += delta;
+		drone->angle += delta * drone->rotspeed;
+		if (drone->left >= 0) {
+			drone->left = (Random(&drone->rng) * (drone->timemax - drone->timemin) + drone->timemin) * ((RandomInt(&drone->rng) % 2) ? 1 : -1);
+		}
+	}
+}
+
+struct DroneJob {
+	struct World* world;
+	const struct Santa* previous;
+	uint8_t hits[MAX_DRONES]; // bitmask of caught players
+};
+
+static void UpdateDrones(int start, int end, void* userdata) {
+	// Runs on the job system; only touches drones in its range and writes results to their own slots.
+	struct DroneJob* job = userdata;
+	struct World* world = job->world;
+	for (int i = start; i < end; i++) {
+		job->hits[i] = 0;
+		if (!world->drones[i].enabled) continue;
+
+		struct Drone drone = world->drones[i];
+		MoveDrone(&world->drones[i], world->delta);
+
+		for (int p = 0; p < world->players; p++) {
+			if (world->santas[p].pause) continue;
+			if (IsSantaSweptThroughDrone(&drone, &world->drones[i], &job->previous[p], &world->santas[p])) {
+				job->hits[i] |= 1 << p;
+			}
+		}
+	}
+}
+
+static bool AreAllSantasCaught(struct World* world) {
+	for (int p = 0; p < world->players; p++) {
+		if (!world->santas[p].pause) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void SimulateWorld(void* state, const void* inputs[MAX_PLAYERS], void* userdata) {
+	// Advances the world by a single fixed tick. Must be deterministic, as both netplay peers run it independently.
+	// The userdata is the job system the drones get updated on.
+	struct JobSystem* jobs = userdata;
+	struct World* world = state;
+	double delta = world->delta;
+
+	if (world->pause) {
+		world->pause -= delta;
+		if (world->pause <= 0) {
+			world->retries++;
+			StartLevel(world, true);
+		}
+		return;
+	}
+
+	struct Santa previous[MAX_PLAYERS];
+	for (int p = 0; p < world->players; p++) {
+		struct Santa* santa = &world->santas[p];
+		if (santa->pause) {
+			santa->pause -= delta;
+			if (santa->pause <= 0) {
+				ResetSanta(world, p);
+			}
+			previous[p] = *santa;
+			continue;
+		}
+		previous[p] = *santa;
+		MoveSanta(santa, inputs[p], delta);
+	}
+
+	struct DroneJob job = {.world = world, .previous = previous};
+	if (world->drone_count >= PARALLEL_THRESHOLD) {
+		ParallelFor(jobs, world->drone_count, PARALLEL_GRAIN, UpdateDrones, &job);
+	} else {
+		UpdateDrones(0, world->drone_count, &job);
+	}
+
+	// resolve hits in drone order, so the result doesn't depend on how the work was split
+	for (int i = 0; i < world->drone_count; i++) {
+		if (!job.hits[i]) continue;
+
+		for (int p = 0; p < world->players; p++) {
+			struct Santa* santa = &world->santas[p];
+			if (santa->pause || !(job.hits[i] & (1 << p))) continue;
+
+			santa->hits++;
+			santa->pause = 2.4;
+			if (AreAllSantasCaught(world)) {
+				world->pause = 2.4;
+				return;
+			}
+		}
+	}
+
+	for (int p = 0; p < world->players; p++) {
+		struct Santa* santa = &world->santas[p];
+		if (!santa->pause && santa->x > 0.99 && santa->y < 0.2) {
+			world->level++;
+			StartLevel(world, false);
+			return;
+		}
+	}
+}
+
+size_t GetWorldSize(const void* state) {
+	// Drones past the highest enabled one are all disabled, and everything else about them gets
+	// overwritten before they're enabled again, so they're left out of netplay snapshots.
+	const struct World* world = state;
+	return offsetof(struct World, drones) + world->drone_count * sizeof(struct Drone);
+}
+
+static int CompareTimes(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+int RunRollbackBenchmark(void) {
+	// Returns non-zero when rollbacks don't fit in the budget. Levels never field more than MAX_DRONES,
+	// so that's the worst case measured. Ticks while Santas are caught are cheap, so the 95th percentile
+	// is checked rather than the median.
+	struct JobSystem* jobs = CreateJobSystem(0);
+	struct World* world = malloc(sizeof(struct World));
+	InitWorld(world, BENCHMARK_SEED, MAX_PLAYERS, DEFAULT_TICK_RATE);
+	world->level = MAX_DRONES; // one drone per level, so this fills the whole field
+	StartLevel(world, false);
+	struct PlayerInput input = {.accelerate = INPUT_HELD_MAX, .left = INPUT_HELD_MAX / 4};
+
+	double times[BENCHMARK_ITERATIONS];
+	NetplayMeasureRollback(sizeof(struct World), sizeof(struct PlayerInput), SimulateWorld, GetWorldSize, jobs, world, &input, NETPLAY_BUDGET_TICKS, 10, times); // warm up
+	NetplayMeasureRollback(sizeof(struct World), sizeof(struct PlayerInput), SimulateWorld, GetWorldSize, jobs, world, &input, NETPLAY_BUDGET_TICKS, BENCHMARK_ITERATIONS, times);
+	qsort(times, BENCHMARK_ITERATIONS, sizeof(double), CompareTimes);
+	double median = times[BENCHMARK_ITERATIONS / 2], p95 = times[BENCHMARK_ITERATIONS * 95 / 100];
+
+	printf("Netplay rollback of %d ticks with %d drones, %d iterations\n", NETPLAY_BUDGET_TICKS, MAX_DRONES, BENCHMARK_ITERATIONS);
+	printf("median %.3f ms  p95 %.3f ms  max %.3f ms  budget %.3f ms\n", median * 1000.0,
+		p95 * 1000.0, times[BENCHMARK_ITERATIONS - 1] * 1000.0, NETPLAY_ROLLBACK_BUDGET * 1000.0);
+
+	free(world);
+	DestroyJobSystem(jobs);
+	if (p95 > NETPLAY_ROLLBACK_BUDGET) {
+		fprintf(stderr, "Netplay rollback FAILED: over the budget\n");
+		return 1;
+	}
+	return 0;
+}
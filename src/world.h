@@ -0,0 +1,67 @@
+/*! \file world.h
+ *  \brief Deterministic simulation of the race.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECRETSANTA_WORLD_H
+#define SECRETSANTA_WORLD_H
+
+#include "netplay.h"
+#include <libsuperderpy.h>
+
+#define MAX_DRONES 42
+#define MAX_PLAYERS NETPLAY_MAX_PLAYERS
+#define DEFAULT_TICK_RATE 60 // movement constants are tuned for this rate
+#define INPUT_HELD_MAX 255
+
+struct PlayerInput {
+	// fraction of the tick during which each control was held, 0 to INPUT_HELD_MAX
+	uint8_t accelerate, brake, left, right;
+};
+
+struct Santa {
+	double x, y, rot, speed, pause;
+	int hits;
+};
+
+struct Drone {
+	bool enabled;
+	uint32_t rng; // each drone has its own random stream, so they can be updated in any order
+	double x, y, counter, angle, left, deviation, speed, rotspeed, timemax, timemin, length, span;
+};
+
+struct World {
+	// Everything that affects gameplay lives here, so it can be saved and restored by the rollback netcode.
+	// Keep it plain old data and don't touch anything outside of it while simulating.
+	uint32_t rng;
+	int players, level, retries;
+	int drone_count; // highest enabled drone index + 1
+	double delta, pause;
+	struct Santa santas[MAX_PLAYERS];
+	struct Drone drones[MAX_DRONES]; // has to stay last, see GetWorldSize
+};
+
+void InitWorld(struct World* world, uint32_t seed, int players, int tick_rate);
+void StartLevel(struct World* world, bool retry);
+void SimulateWorld(void* state, const void* inputs[MAX_PLAYERS], void* userdata);
+size_t GetWorldSize(const void* state);
+void GetDroneTriangle(const struct Drone* drone, double* x1, double* y1, double* x2, double* y2, double* x3, double* y3);
+bool IsSantaInDroneTriangle(const struct Drone* drone, const struct Santa* santa);
+int RunRollbackBenchmark(void);
+
+#endif
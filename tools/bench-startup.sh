@@ -0,0 +1,180 @@
+#!/bin/sh
+# Startup benchmark: runs a build made with -DSTARTUP_BENCHMARK=ON several
+# times with cold and warm caches and writes the median time of each phase
+# to a JSON file. With -b, the result gets compared against a stored baseline
+# and the script fails when any phase got slower than the threshold allows.
+#
+# Without a display, it re-runs itself under xvfb-run with llvmpipe, so it
+# works on CI machines without a GPU.
+#
+# Cold runs drop the whole page cache when permitted (i.e. as root), and
+# otherwise evict just the executable, its libraries and the game data.
+# The shader cache in the user's cache directory is left alone.
+
+set -e
+
+usage() {
+	echo "Usage: $0 [-n runs] [-o output.json] [-b baseline.json] [-t percent] [-m ms] [-d datadir] executable [args...]" >&2
+	exit 2
+}
+
+RUNS=5
+OUTPUT=startup.json
+BASELINE=
+THRESHOLD=10 # percent
+MIN_DIFF=5 # ms; smaller differences are noise, whatever the percentage
+DATADIR="$(dirname "$0")/../data"
+
+while getopts n:o:b:t:m:d: opt; do
+	case $opt in
+		n) RUNS=$OPTARG ;;
+		o) OUTPUT=$OPTARG ;;
+		b) BASELINE=$OPTARG ;;
+		t) THRESHOLD=$OPTARG ;;
+		m) MIN_DIFF=$OPTARG ;;
+		d) DATADIR=$OPTARG ;;
+		*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -ge 1 ] || usage
+EXECUTABLE=$1
+shift
+
+if [ -z "$DISPLAY" ] && [ -z "$WAYLAND_DISPLAY" ]; then
+	if ! command -v xvfb-run >/dev/null; then
+		echo "No display and no xvfb-run available" >&2
+		exit 1
+	fi
+	LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe exec xvfb-run -a -s "-screen 0 1920x1080x24" "$0" \
+		-n "$RUNS" -o "$OUTPUT" ${BASELINE:+-b "$BASELINE"} -t "$THRESHOLD" -m "$MIN_DIFF" -d "$DATADIR" "$EXECUTABLE" "$@"
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+drop_caches() {
+	sync
+	if echo 3 2>/dev/null >/proc/sys/vm/drop_caches; then
+		CACHES=system
+		return
+	fi
+	CACHES=files
+	{
+		echo "$EXECUTABLE"
+		ldd "$EXECUTABLE" 2>/dev/null | sed -n 's/.*=> \(\/[^ ]*\).*/\1/p'
+		find "$DATADIR" -type f 2>/dev/null
+	} | while read -r file; do
+		dd if="$file" iflag=nocache count=0 status=none 2>/dev/null || true
+	done
+}
+
+run() {
+	RESULT=$1
+	shift
+	SECRETSANTA_LAUNCH_TIME=$(date +%s.%N) "$EXECUTABLE" --bench-startup="$RESULT" "$@" >/dev/null || {
+		echo "Run of $EXECUTABLE failed" >&2
+		exit 1
+	}
+}
+
+i=1
+while [ $i -le "$RUNS" ]; do
+	drop_caches
+	run "$TMP/cold-$i.json" "$@"
+	i=$((i + 1))
+done
+
+run "$TMP/prime.json" "$@"
+i=1
+while [ $i -le "$RUNS" ]; do
+	run "$TMP/warm-$i.json" "$@"
+	i=$((i + 1))
+done
+
+# medians of every phase, in the order they happened
+awk -v runs="$RUNS" -v caches="$CACHES" '
+	function median(key,    n, i, j, v, tmp) {
+		n = split(values[key], v, " ")
+		for (i = 2; i <= n; i++) {
+			for (j = i; j > 1 && v[j - 1] + 0 > v[j] + 0; j--) {
+				tmp = v[j]; v[j] = v[j - 1]; v[j - 1] = tmp
+			}
+		}
+		return (n % 2) ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+	}
+	FNR == 1 { mode = (FILENAME ~ /\/cold-/) ? "cold" : "warm" }
+	/"name":/ {
+		match($0, /"name": "[^"]*"/)
+		name = substr($0, RSTART + 9, RLENGTH - 10)
+		match($0, /"ms": [0-9.]*/)
+		add(mode, name, substr($0, RSTART + 6, RLENGTH - 6))
+	}
+	/"total_ms":/ {
+		match($0, /[0-9.]+/)
+		add(mode, "total", substr($0, RSTART, RLENGTH))
+	}
+	function add(mode, name, value,    key) {
+		key = mode SUBSEP name
+		if (!(key in values)) {
+			order[mode, ++count[mode]] = name
+		}
+		values[key] = values[key] " " value
+	}
+	END {
+		printf "{\n"
+		for (m = 1; m <= 2; m++) {
+			mode = (m == 1) ? "cold" : "warm"
+			printf "\t\"%s\": {\n", mode
+			for (i = 1; i <= count[mode]; i++) {
+				printf "\t\t\"%s\": %.3f%s\n", order[mode, i], median(mode SUBSEP order[mode, i]), (i < count[mode]) ? "," : ""
+			}
+			printf "\t},\n"
+		}
+		printf "\t\"runs\": %d,\n\t\"caches\": \"%s\"\n}\n", runs, caches
+	}
+' "$TMP"/cold-*.json "$TMP"/warm-*.json >"$OUTPUT"
+
+echo "Medians of $RUNS runs written to $OUTPUT (cold runs with $CACHES caches dropped)"
+
+[ -n "$BASELINE" ] || exit 0
+
+awk -v threshold="$THRESHOLD" -v min_diff="$MIN_DIFF" '
+	/^\t"(cold|warm)": \{/ {
+		match($0, /"[a-z]*"/)
+		mode = substr($0, RSTART + 1, RLENGTH - 2)
+		next
+	}
+	/^\t\t"/ {
+		match($0, /"[^"]*"/)
+		name = substr($0, RSTART + 1, RLENGTH - 2)
+		match($0, /: [0-9.]+/)
+		value = substr($0, RSTART + 2, RLENGTH - 2) + 0
+		if (FILENAME == ARGV[1]) {
+			base[mode, name] = value
+		} else {
+			order[++count] = mode SUBSEP name
+			current[mode, name] = value
+		}
+	}
+	END {
+		printf "%-5s %-28s %10s %10s %8s\n", "mode", "phase", "baseline", "now", "change"
+		for (i = 1; i <= count; i++) {
+			split(order[i], key, SUBSEP)
+			now = current[order[i]]
+			if (!(order[i] in base)) {
+				printf "%-5s %-28s %10s %7.2f ms %8s\n", key[1], key[2], "-", now, "new"
+				continue
+			}
+			was = base[order[i]]
+			change = was ? (now - was) / was * 100 : 0
+			bad = now - was > min_diff && now > was * (1 + threshold / 100)
+			printf "%-5s %-28s %7.2f ms %7.2f ms %+7.1f%%%s\n", key[1], key[2], was, now, change, bad ? "  REGRESSION" : ""
+			failed += bad
+		}
+		if (failed) {
+			printf "Startup benchmark FAILED: %d phases more than %s%% (and %s ms) slower than the baseline\n", failed, threshold, min_diff
+			exit 1
+		}
+	}
+' "$BASELINE" "$OUTPUT"